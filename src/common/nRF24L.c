@@ -8,14 +8,93 @@
 #  endif
 #endif
 
+#include <stdbool.h>
+
 #include "nRF24L.h"
 
+#if defined(AVR)  &&  defined(NRF_SPI_ASYNC)
+#  include <avr/interrupt.h>
+#  include <avr/sleep.h>
+#endif
+
 uint8_t __xdata nRF_data[MAX_COMMAND_LENGTH];
 
+// The shadow of the nRF configuration registers: the writes that don't change a register
+// are skipped, and the reads are served from here. STATUS, OBSERVE_TX, RPD and FIFO_STATUS
+// are changed by the nRF itself, so they always go to the chip. The 5 byte address
+// registers have a shadow of their own.
+#define SHADOW_REGS			(FEATURE + 1)
+#define SHADOW_ADDR_REGS	3			// RX_ADDR_P0, RX_ADDR_P1 and TX_ADDR
+#define MAX_ADDR_LEN		5
+
+uint8_t __xdata nRF_shadow[SHADOW_REGS];
+uint8_t __xdata nRF_shadow_valid[(SHADOW_REGS + 7) / 8];		// bit mask of the registers in nRF_shadow
+uint8_t __xdata nRF_shadow_addr[SHADOW_ADDR_REGS][MAX_ADDR_LEN];
+uint8_t __xdata nRF_shadow_addr_len[SHADOW_ADDR_REGS];			// 0 if the address is not known
+
+uint32_t nRF_spi_bytes_saved;
+
+void nRF_InvalidateShadow(void)
+{
+	uint8_t c;
+
+	for (c = 0; c < sizeof nRF_shadow_valid; c++)
+		nRF_shadow_valid[c] = 0;
+
+	for (c = 0; c < SHADOW_ADDR_REGS; c++)
+		nRF_shadow_addr_len[c] = 0;
+}
+
+static bool nRF_IsShadowed(const uint8_t reg)
+{
+	return reg < SHADOW_REGS
+			&&  reg != STATUS  &&  reg != OBSERVE_TX  &&  reg != RPD  &&  reg != FIFO_STATUS
+			&&  reg != RX_ADDR_P0  &&  reg != RX_ADDR_P1  &&  reg != TX_ADDR;
+}
+
+#define IS_SHADOW_VALID(reg)	(nRF_shadow_valid[(reg) >> 3] & _BV((reg) & 7))
+#define SET_SHADOW_VALID(reg)	(nRF_shadow_valid[(reg) >> 3] |= _BV((reg) & 7))
+
+// returns the index in nRF_shadow_addr
+static uint8_t nRF_ShadowAddrIndex(const uint8_t reg)
+{
+	if (reg == RX_ADDR_P0)
+		return 0;
+
+	if (reg == RX_ADDR_P1)
+		return 1;
+
+	if (reg == TX_ADDR)
+		return 2;
+
+	return SHADOW_ADDR_REGS;
+}
+
+#ifdef NRF_SPI_TIMING
+
+uint32_t nRF_spi_payload_bytes;
+uint32_t nRF_spi_wall_cycles;
+uint32_t nRF_spi_active_cycles;
+
+// Timer1 runs from the CPU clock, and keeps running while the CPU idles
+#  define SPI_TIMING_BEGIN()			const uint16_t timing_started = TCNT1
+#  define SPI_TIMING_END(bytes, idle)	do {																\
+											const uint16_t cycles = TCNT1 - timing_started;				\
+											nRF_spi_payload_bytes += (bytes);							\
+											nRF_spi_wall_cycles += cycles;								\
+											nRF_spi_active_cycles += cycles - (idle);					\
+										} while (0)
+#else
+#  define SPI_TIMING_BEGIN()
+#  define SPI_TIMING_END(bytes, idle)
+#endif
+
 #ifdef AVR
 
 void nRF_Init(void)
 {
+	nRF_InvalidateShadow();
+
 #ifdef NRF_PWR_PORT
 	// the 3.3v voltage regulator
 	SetBit(DDR(NRF_PWR_PORT), NRF_PWR_BIT);
@@ -49,14 +128,25 @@ void nRF_Init(void)
 	// enable SPI in Master Mode with SCK = CK/4
 	SetVal(SPCR, _BV(SPE) | _BV(MSTR));
 
+#ifdef NRF_SPI_2X
+	SetBit(SPSR, SPI2X);	// SCK = CK/2
+#endif
+
 	SPSR;	// clear SPIF bit in SPSR
 	SPDR;
+
+#ifdef NRF_SPI_TIMING
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);		// Timer1 in normal mode, no prescaler
+#endif
 }
 
 #else
 
 void nRF_Init(void)
 {
+	nRF_InvalidateShadow();
+
 #ifdef NRF24LU1
 	// LE1 has the internal SPI enabled all the time
 	RFCTL = 0x11;	// enable SPI, 1/2 clock
@@ -118,6 +208,121 @@ static uint8_t nRF_ShiftCommand(uint8_t cmd_len)
 	return *nRF_data;
 }
 
+#if defined(AVR)  &&  defined(NRF_SPI_ASYNC)
+
+// The async transfers: the SPI interrupt shifts the next byte when the last one is done.
+// At SCK = F_CPU/4 a byte takes only 32 CPU cycles, which is not much more than the
+// interrupt itself, so this pays off with a slower SCK or long transfers only.
+// NRF_SPI_TIMING shows the difference.
+static const uint8_t* spi_tx;
+static uint8_t* spi_rx;
+static uint8_t spi_remaining;
+static bool spi_is_cmd;
+static nRF_transfer_done_cb_t spi_done_cb;
+static volatile bool spi_is_busy = false;
+
+#ifdef NRF_SPI_TIMING
+static uint16_t spi_idle_cycles;	// the time slept in nRF_WaitTransfer()
+#endif
+
+ISR(SPI_STC_vect)
+{
+	const uint8_t rcvd = SPDR;
+
+	if (spi_is_cmd)
+	{
+		nRF_data[0] = rcvd;		// the STATUS register
+		spi_is_cmd = false;
+	} else if (spi_rx) {
+		*spi_rx++ = rcvd;
+	}
+
+	if (spi_remaining)
+	{
+		--spi_remaining;
+		SPDR = spi_tx ? *spi_tx++ : NOP;
+	} else {
+		nRF_CSN_hi();
+		ClrBit(SPCR, SPIE);
+		spi_is_busy = false;
+
+		if (spi_done_cb)
+			spi_done_cb();
+	}
+}
+
+void nRF_StartTransfer(const uint8_t cmd, const uint8_t* tx, uint8_t* rx, const uint8_t num_bytes, nRF_transfer_done_cb_t done)
+{
+	nRF_WaitTransfer();		// one at a time
+
+	spi_tx = tx;
+	spi_rx = rx;
+	spi_remaining = num_bytes;
+	spi_is_cmd = true;
+	spi_done_cb = done;
+	spi_is_busy = true;
+
+	nRF_CSN_lo();
+	SetBit(SPCR, SPIE);
+	SPDR = cmd;
+}
+
+void nRF_WaitTransfer(void)
+{
+	const uint8_t smcr = SMCR;		// the caller's sleep mode
+
+	set_sleep_mode(SLEEP_MODE_IDLE);	// the SPI needs the IO clock
+
+	cli();
+	while (spi_is_busy)
+	{
+#ifdef NRF_SPI_TIMING
+		const uint16_t slept = TCNT1;
+#endif
+		sleep_enable();
+		sei();
+		sleep_cpu();		// the SPI interrupt wakes us up
+		sleep_disable();
+		cli();
+#ifdef NRF_SPI_TIMING
+		spi_idle_cycles += TCNT1 - slept;
+#endif
+	}
+	sei();
+
+	SMCR = smcr;
+}
+
+// shifts a payload with the SPI interrupt, and sleeps until it's done
+static uint8_t nRF_TransferPayload(const uint8_t cmd, const uint8_t* tx, uint8_t* rx, const uint8_t num_bytes)
+{
+	SPI_TIMING_BEGIN();
+#ifdef NRF_SPI_TIMING
+	spi_idle_cycles = 0;
+#endif
+
+	nRF_StartTransfer(cmd, tx, rx, num_bytes, NULL);
+	nRF_WaitTransfer();
+
+	SPI_TIMING_END(num_bytes, spi_idle_cycles);
+
+	return nRF_data[0];
+}
+
+#endif	// NRF_SPI_ASYNC
+
+// The streaming commands shift the data straight between the caller's buffer and
+// the nRF instead of going through nRF_data. This starts the command and returns
+// the STATUS register; the caller shifts the data and ends with nRF_CSN_hi().
+static uint8_t nRF_StreamBegin(const uint8_t cmd)
+{
+	nRF_CSN_lo();
+
+	*nRF_data = nRF_SpiShiftByte(cmd);
+
+	return *nRF_data;
+}
+
 uint8_t nRF_ShiftByte(const uint8_t one_byte)
 {
 	nRF_CSN_lo();
@@ -133,37 +338,102 @@ uint8_t nRF_ShiftByte(const uint8_t one_byte)
 
 uint8_t nRF_ReadReg(const enum nRFRegister_e reg)
 {
+	const bool is_shadowed = nRF_IsShadowed(reg);
+	if (is_shadowed  &&  IS_SHADOW_VALID(reg))
+	{
+		// no SPI transfer, so nRF_data[0] keeps the STATUS of the last command
+		nRF_data[1] = nRF_shadow[reg];
+		nRF_spi_bytes_saved += 2;
+
+		return nRF_data[0];
+	}
+
 	nRF_data[0] = R_REGISTER | reg;
+	nRF_ShiftCommand(2);
 
-	return nRF_ShiftCommand(2);
+	if (is_shadowed)
+	{
+		nRF_shadow[reg] = nRF_data[1];
+		SET_SHADOW_VALID(reg);
+	}
+
+	return nRF_data[0];
 }
 
 uint8_t nRF_WriteReg(const enum nRFRegister_e reg, const uint8_t val)
 {
+	if (nRF_IsShadowed(reg))
+	{
+		if (IS_SHADOW_VALID(reg)  &&  nRF_shadow[reg] == val)
+		{
+			nRF_spi_bytes_saved += 2;
+			return nRF_data[0];
+		}
+
+		nRF_shadow[reg] = val;
+		SET_SHADOW_VALID(reg);
+	}
+
 	nRF_data[0] = W_REGISTER | reg;
 	nRF_data[1] = val;
 
 	return nRF_ShiftCommand(2);
 }
 
-uint8_t nRF_WriteAddrReg(const enum nRFRegister_e reg, const uint8_t __code * addr, const uint8_t addr_len)
+uint8_t nRF_WriteAddrReg(const enum nRFRegister_e reg, const uint8_t __code * addr, uint8_t addr_len)
 {
-	uint8_t c;
-	
-	nRF_data[0] = W_REGISTER | reg;
+	const uint8_t ndx = nRF_ShadowAddrIndex(reg);
+	uint8_t status, c;
+
+	if (ndx < SHADOW_ADDR_REGS)
+	{
+		if (nRF_shadow_addr_len[ndx] == addr_len)
+		{
+			for (c = 0; c < addr_len  &&  nRF_shadow_addr[ndx][c] == addr[c]; c++)
+				;
+
+			if (c == addr_len)
+			{
+				nRF_spi_bytes_saved += addr_len + 1;
+				return nRF_data[0];
+			}
+		}
+
+		for (c = 0; c < addr_len; c++)
+			nRF_shadow_addr[ndx][c] = addr[c];
+
+		nRF_shadow_addr_len[ndx] = addr_len;
+	}
 
-	// set the data to be sent
-	for (c = 0; c < addr_len; c++)
-		nRF_data[1 + c] = addr[c];
+	status = nRF_StreamBegin(W_REGISTER | reg);
 
-	return nRF_ShiftCommand(addr_len + 1);
+	while (addr_len--)
+		nRF_SpiShiftByte(*addr++);
+
+	nRF_CSN_hi();
+
+	return status;
 }
 
+// This always reads the chip, so the address can be read back to check the
+// connection to the nRF. The shadow is updated with what we read.
 uint8_t nRF_ReadAddrReg(const enum nRFRegister_e reg, const uint8_t addr_len)
 {
+	const uint8_t ndx = nRF_ShadowAddrIndex(reg);
+	uint8_t c;
+
 	nRF_data[0] = R_REGISTER | reg;
+	nRF_ShiftCommand(addr_len + 1);
+
+	if (ndx < SHADOW_ADDR_REGS)
+	{
+		for (c = 0; c < addr_len; c++)
+			nRF_shadow_addr[ndx][c] = nRF_data[1 + c];
+
+		nRF_shadow_addr_len[ndx] = addr_len;
+	}
 
-	return nRF_ShiftCommand(addr_len + 1);
+	return nRF_data[0];
 }
 
 uint8_t nRF_ReadRxPayload(const uint8_t num_bytes)
@@ -173,17 +443,44 @@ uint8_t nRF_ReadRxPayload(const uint8_t num_bytes)
 	return nRF_ShiftCommand(num_bytes + 1);
 }
 
-uint8_t nRF_WriteTxPayload(const uint8_t* payload, const uint8_t num_bytes)
+uint8_t nRF_ReadRxPayloadTo(uint8_t __xdata * buff, uint8_t num_bytes)
 {
+#if defined(AVR)  &&  defined(NRF_SPI_ASYNC)
+	return nRF_TransferPayload(R_RX_PAYLOAD, NULL, buff, num_bytes);
+#else
 	uint8_t c;
-	
-	nRF_data[0] = W_TX_PAYLOAD;
+	SPI_TIMING_BEGIN();
+	const uint8_t status = nRF_StreamBegin(R_RX_PAYLOAD);
 
-	// set the data to be sent
 	for (c = 0; c < num_bytes; c++)
-		nRF_data[1 + c] = payload[c];
+		buff[c] = nRF_SpiShiftByte(NOP);
 
-	return nRF_ShiftCommand(num_bytes + 1);
+	nRF_CSN_hi();
+
+	SPI_TIMING_END(num_bytes, 0);
+
+	return status;
+#endif
+}
+
+uint8_t nRF_WriteTxPayload(const uint8_t* payload, uint8_t num_bytes)
+{
+#if defined(AVR)  &&  defined(NRF_SPI_ASYNC)
+	return nRF_TransferPayload(W_TX_PAYLOAD, payload, NULL, num_bytes);
+#else
+	uint8_t c;
+	SPI_TIMING_BEGIN();
+	const uint8_t status = nRF_StreamBegin(W_TX_PAYLOAD);
+
+	for (c = 0; c < num_bytes; c++)
+		nRF_SpiShiftByte(payload[c]);
+
+	nRF_CSN_hi();
+
+	SPI_TIMING_END(num_bytes, 0);
+
+	return status;
+#endif
 }
 
 uint8_t nRF_ReuseTxPayload(void)
@@ -213,23 +510,24 @@ uint8_t nRF_ReadRxPayloadWidth(void)
 	return nRF_ShiftCommand(2);
 }
 
-uint8_t nRF_WriteAckPayload(const uint8_t __xdata * payload, const uint8_t num_bytes, const uint8_t pipe_num)
+uint8_t nRF_WriteAckPayload(const uint8_t __xdata * payload, uint8_t num_bytes, const uint8_t pipe_num)
 {
-	uint8_t c;
+	const uint8_t status = nRF_StreamBegin(W_ACK_PAYLOAD | pipe_num);
 
-	nRF_data[0] = W_ACK_PAYLOAD | pipe_num;
+	while (num_bytes--)
+		nRF_SpiShiftByte(*payload++);
 
-	// set the data to be sent
-	for (c = 0; c < num_bytes; c++)
-		nRF_data[1 + c] = payload[c];
+	nRF_CSN_hi();
 
-	return nRF_ShiftCommand(num_bytes + 1);
+	return status;
 }
 
 #ifdef NRF_PWR_PORT
 
 void nRF_Reset(void)
 {
+	nRF_InvalidateShadow();		// the registers go back to their reset values
+
 	// First turn off all the output pins and the pull-up resistors of the input pins
 	// of the ATmega that are used to communicate with the nRF module.
 	// If these are left on, the nRF will not reset. I am not sure why this is, but
@@ -267,22 +267,39 @@ extern __xdata uint8_t nRF_data[MAX_COMMAND_LENGTH];
 
 void nRF_Init(void);
 
-// All the command functions return the value of the STATUS register.
-// The nRF_Read* commands store the data from the chip starting from nRF_data[1]
+// The configuration registers are shadowed: writing the value a register already has
+// costs no SPI transfer, and reading it returns the shadow in nRF_data[1]. Neither talks
+// to the chip then, so the STATUS they return (and leave in nRF_data[0]) is the one from
+// the last SPI command and its IRQ flags can be stale. For a fresh STATUS use nRF_NOP(),
+// or read one of the registers the nRF changes itself (STATUS, OBSERVE_TX, RPD,
+// FIFO_STATUS) or an address register; those are never served from the shadow.
+// The shadow is reset by nRF_Init() and nRF_Reset(); call nRF_InvalidateShadow()
+// if the nRF could have lost its registers some other way.
+void nRF_InvalidateShadow(void);
+
+extern uint32_t nRF_spi_bytes_saved;		// the SPI bytes the shadow has saved
+
+// All the command functions return the value of the STATUS register (see above for
+// the registers in the shadow).
+// The nRF_Read* commands store the data from the chip starting from nRF_data[1],
+// except for nRF_ReadRxPayloadTo() which reads straight into the caller's buffer.
+// The commands that write a buffer (addresses and payloads) shift it straight
+// from the caller's buffer; they only set nRF_data[0].
 
 // read/write the single-byte registers
 uint8_t nRF_WriteReg(const enum nRFRegister_e reg, const uint8_t val);
 uint8_t nRF_ReadReg(const enum nRFRegister_e reg);
 
 // read/write the address registers
-uint8_t nRF_WriteAddrReg(const enum nRFRegister_e reg, const uint8_t __code * addr, const uint8_t addr_len);
+uint8_t nRF_WriteAddrReg(const enum nRFRegister_e reg, const uint8_t __code * addr, uint8_t addr_len);
 uint8_t nRF_ReadAddrReg(const enum nRFRegister_e reg, const uint8_t addr_len);
 
 // reads the RX payload (max num_bytes == 32)
 uint8_t nRF_ReadRxPayload(const uint8_t num_bytes);
+uint8_t nRF_ReadRxPayloadTo(uint8_t __xdata * buff, uint8_t num_bytes);
 
 // writes the TX payload (max num_bytes == 32)
-uint8_t nRF_WriteTxPayload(const uint8_t* payload, const uint8_t num_bytes);
+uint8_t nRF_WriteTxPayload(const uint8_t* payload, uint8_t num_bytes);
 
 // tries to send the last payload again (needs CE pulse)
 uint8_t nRF_ReuseTxPayload(void);
@@ -295,7 +312,32 @@ uint8_t nRF_FlushRX(void);
 uint8_t nRF_ReadRxPayloadWidth(void);
 
 // writes the ACK payload (num_bytes <= 32, pipe_num <= 5)
-uint8_t nRF_WriteAckPayload(const uint8_t __xdata * payload, const uint8_t num_bytes, const uint8_t pipe_num);
+uint8_t nRF_WriteAckPayload(const uint8_t __xdata * payload, uint8_t num_bytes, const uint8_t pipe_num);
+
+// The SPI options for the AVR; these are set in hw_setup.h
+// NRF_SPI_2X		SCK = F_CPU/2 instead of F_CPU/4
+// NRF_SPI_ASYNC	the payloads are shifted by the SPI interrupt while the CPU idles
+// NRF_SPI_TIMING	measures the payload transfers with Timer1 (in CPU cycles)
+#if defined(AVR)  &&  defined(NRF_SPI_ASYNC)
+
+// called from the SPI interrupt when a transfer is done
+typedef void (*nRF_transfer_done_cb_t)(void);
+
+// Starts shifting the command and num_bytes of data; tx == NULL shifts NOPs, and rx == NULL
+// drops the bytes received. The buffers have to stay valid until the transfer is done.
+// The STATUS register is in nRF_data[0] when the transfer is done.
+void nRF_StartTransfer(const uint8_t cmd, const uint8_t* tx, uint8_t* rx, const uint8_t num_bytes, nRF_transfer_done_cb_t done);
+
+// sleeps in idle mode until the transfer is done
+void nRF_WaitTransfer(void);
+
+#endif
+
+#ifdef NRF_SPI_TIMING
+extern uint32_t nRF_spi_payload_bytes;		// the payload bytes transferred
+extern uint32_t nRF_spi_wall_cycles;		// the time the transfers took
+extern uint32_t nRF_spi_active_cycles;		// the time the CPU was awake during the transfers
+#endif
 
 // the NOP command
 uint8_t nRF_NOP(void);
@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rf_profiles.h"
+#include "rf_protocol.h"
+
+__FLASH_ATTR const rf_reg_val_t rf_profile_keyb_tx[] =
+{
+	{EN_AA,			vENAA_P0},						// enable auto acknowledge
+	{EN_RXADDR,		vERX_P0},						// enable RX address (for ACK)
+	{SETUP_RETR,	vARD_250us | 0x0f},				// ARD=250us, ARC=15
+	{FEATURE,		vEN_DPL | vEN_ACK_PAY},			// enable dynamic payload length and ACK payload
+	{DYNPD,			vDPL_P0},						// enable dynamic payload length for pipe 0
+	{RF_CH,			CHANNEL_NUM},					// set the channel
+	{undefined_reg,	0},
+};
+
+__FLASH_ATTR const rf_reg_val_t rf_profile_dongle_rx[] =
+{
+	{EN_AA,			vENAA_P0 | vENAA_P1 | vENAA_P2 | vENAA_P3 | vENAA_P4 | vENAA_P5},	// enable auto acknowledge
+	{EN_RXADDR,		vERX_P0 | vERX_P1 | vERX_P2 | vERX_P3 | vERX_P4 | vERX_P5},		// enable RX addresses
+	{SETUP_RETR,	vARD_250us},					// ARD=250us, ARC=disabled
+	{RF_SETUP,		vRF_DR_2MBPS | vRF_PWR_0DBM},	// data rate, output power
+	{FEATURE,		vEN_DPL | vEN_ACK_PAY},			// enable dynamic payload length and ACK payload
+	{DYNPD,			vDPL_P0 | vDPL_P1 | vDPL_P2 | vDPL_P3 | vDPL_P4 | vDPL_P5},		// enable dynamic payload length for all pipes
+	{RF_CH,			CHANNEL_NUM},					// set the channel
+	{CONFIG,		vEN_CRC | vCRCO 				// enable a 2 byte CRC
+					| vMASK_TX_DS					// we don't care about the TX_DS status flag
+					| vPRIM_RX						// RX mode
+					| vPWR_UP},						// power up the transceiver
+	{undefined_reg,	0},
+};
+
+void rf_apply_profile(__FLASH_ATTR const rf_reg_val_t* profile)
+{
+	for (; profile->reg != undefined_reg; ++profile)
+		nRF_WriteReg(profile->reg, profile->val);
+}
+
+bool rf_verify_profile(__FLASH_ATTR const rf_reg_val_t* profile)
+{
+	// read the chip, not the shadow
+	nRF_InvalidateShadow();
+
+	for (; profile->reg != undefined_reg; ++profile)
+	{
+		nRF_ReadReg(profile->reg);
+		if (nRF_data[1] != profile->val)
+			return false;
+	}
+
+	return true;
+}
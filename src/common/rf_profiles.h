@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "tgtdefs.h"
+#include "nRF24L.h"
+
+// The radio configurations of the keyboard and the dongle as {register, value} tables.
+// Both firmwares take them from here, so the settings the two sides depend on (channel,
+// dynamic payloads, ACK payloads) can't drift apart.
+//
+// A profile holds only the single-byte configuration registers; the addresses and STATUS
+// are written separately. The table ends with an undefined_reg entry.
+//
+// The nRF has no command to write several registers at once, so every register is still
+// its own 2 byte transfer, but nRF_WriteReg() skips the registers the shadow says already
+// have the value. Switching between profiles costs 2 SPI bytes per register that differs.
+
+typedef struct
+{
+	uint8_t		reg;
+	uint8_t		val;
+} rf_reg_val_t;
+
+extern __FLASH_ATTR const rf_reg_val_t rf_profile_keyb_tx[];	// keyboard: PTX on pipe 0
+extern __FLASH_ATTR const rf_reg_val_t rf_profile_dongle_rx[];	// dongle: PRX on all the pipes, powered up
+
+// write the profile's registers
+void rf_apply_profile(__FLASH_ATTR const rf_reg_val_t* profile);
+
+// read the profile's registers back from the chip, returns false on the first mismatch
+bool rf_verify_profile(__FLASH_ATTR const rf_reg_val_t* profile);
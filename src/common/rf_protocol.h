@@ -10,7 +10,14 @@ enum msg_type_t
 	
 	// ACK payload (dongle -> keyboard)
 	MT_LED_STATUS,			// update the status of the LEDs
-	MT_TEXT_BUFF_FREE,		// number of free chars in the message text buffer on the dongle
+	MT_TEXT_CREDITS,		// how much text the keyboard may send to the dongle
+
+	// normal message payload (keyboard -> dongle)
+	MT_KEY_EVENTS,			// key press/release events since the last message
+	MT_TEXT_PACKED,			// MT_TEXT with the packed text encoding (see text_templates.h)
+
+	// ACK payload (dongle -> keyboard)
+	MT_HOST_STATE,			// the USB host has suspended or resumed
 };
 
 // communication address
@@ -19,6 +26,12 @@ enum msg_type_t
 extern const uint8_t DongleAddr1[NRF_ADDR_SIZE];
 extern const uint8_t DongleAddr2[NRF_ADDR_SIZE];
 
+// The dongle listens on all the nRF pipes, so it can serve up to six keyboards. Pipe 0
+// uses DongleAddr1, pipe 1 DongleAddr2, and pipes 2 to 5 DongleAddr2 with its first
+// (least significant) byte incremented by 1 to 4. The nRF compares only that byte.
+#define RF_NUM_PIPES			6
+#define PIPE_ADDR_LSB(pipe)		(DongleAddr2[0] + (pipe) - 1)
+
 // the maximum number of keys that the one packet will carry
 #define MAX_KEYS		6
 
@@ -41,16 +54,56 @@ typedef struct
 	uint8_t		keys[MAX_KEYS];
 } rf_msg_key_state_report_t;
 
+// the maximum number of events in one key events message
+#define MAX_KEY_EVENTS	7
+
+// The header byte of the key events message contains the sequence number of the
+// first event in the upper 5 bits and the number of events in the lower 3 bits.
+// The sequence number increments on every event, and it is used by the dongle
+// to ignore the events it has already applied if a message has been resent.
+#define KEY_EVENTS_SEQ_MASK			0x1f
+#define KEY_EVENTS_HEADER(seq, cnt)	(((seq) << 3) | (cnt))
+#define KEY_EVENTS_SEQ(header)		((header) >> 3)
+#define KEY_EVENTS_CNT(header)		((header) & 0x07)
+
+// Every event is one byte: the key state in bit 7 (1 == pressed) and
+// the event code in the lower 7 bits. Keycodes up to KC_APPLICATION are sent
+// as they are, the modifiers and the consumer bits are mapped into the
+// unused keycode range.
+#define KEY_EVENT_PRESSED		0x80
+#define KEY_EVENT_CODE_MASK		0x7f
+#define KEY_EVENT_MAX_KEYCODE	0x67
+#define KEY_EVENT_MOD_FIRST		0x68	// + the modifier bit (0 == LCTRL ... 7 == RGUI)
+#define KEY_EVENT_CONS_FIRST	0x70	// + the consumer bit (FN_MUTE_BIT ... FN_NEXT_TRACK_BIT)
+
+typedef struct
+{
+	uint8_t		msg_type;		// == MT_KEY_EVENTS
+	uint8_t		header;			// sequence number and event count
+	uint8_t		events[MAX_KEY_EVENTS];
+} rf_msg_key_events_t;
+
 #define MAX_TEXT_LEN	30
 
 typedef struct
 {
-	uint8_t		msg_type;		// == MT_TEXT
-	uint8_t		msg_id;			// increments on every text message
+	uint8_t		msg_type;		// == MT_TEXT or MT_TEXT_PACKED
+	uint8_t		msg_id;			// the keyboard's text byte counter before this message
 								// used to ignore text messages that have been resent
 	char		text[MAX_TEXT_LEN];
 } rf_msg_text_t;
 
+// Text flow control: the keyboard counts the text buffer bytes it has sent (the text
+// of every message plus one for the key-up the dongle adds at the end) and sends the
+// counter in msg_id. A packed message counts as the text it unpacks to.
+// The dongle responds to every text message with the credit limit:
+// the counter value up to which the keyboard may send. The limit only moves forward
+// as the dongle types the text out, so a late ACK payload can't grant too much.
+// An empty text message is a probe; it makes the dongle send its credits.
+// The keyboards share the dongle's text buffer, so the credits of one are at most a
+// part of it. The keyboard's text has been typed out once the dongle reports typed_out
+// in the ACK payload of a message sent after its last text message.
+
 
 typedef struct
 {
@@ -61,7 +114,35 @@ typedef struct
 
 typedef struct
 {
-	uint8_t		msg_type;		// == MT_TEXT_BUFF_FREE
-	uint8_t		bytes_free;
-	uint8_t		bytes_capacity;
-} rf_msg_text_buff_state_t;
+	uint8_t		msg_type;		// == MT_TEXT_CREDITS
+	uint8_t		credit_limit;	// the keyboard may send up to this text byte counter
+	uint8_t		capacity;		// the size of the dongle's text buffer
+	uint8_t		templates_version;	// TEXT_TEMPLATES_VERSION of the dongle
+	uint8_t		typed_out;		// 1 if the dongle's text buffer is empty, 0 if not
+} rf_msg_text_credits_t;
+
+// While the host is suspended the dongle listens only RF_SUSPEND_RX_ON_MS out of every
+// RF_SUSPEND_PERIOD_MS. The keyboard stretches its retransmit delay to RF_SUSPEND_ARD, so
+// its retransmits span a whole period and one of them falls into a listen window.
+#define HOST_SUSPENDED			0x01
+
+#define RF_SUSPEND_PERIOD_MS	48
+#define RF_SUSPEND_RX_ON_MS		6
+#define RF_SUSPEND_ARD			vARD_3500us		// 16 attempts take about 55ms
+
+typedef struct
+{
+	uint8_t		msg_type;		// == MT_HOST_STATE
+	uint8_t		host_state;		// HOST_SUSPENDED or 0
+} rf_msg_host_state_t;
+
+// An ACK payload carries one or more of the messages above back to back. There is
+// no length field; the size of every message follows from its type. The receiver
+// stops at the first type it doesn't know.
+#define ACK_MSG_SIZE(msg_type)	((msg_type) == MT_LED_STATUS ? sizeof(rf_msg_led_status_t)		\
+								: (msg_type) == MT_TEXT_CREDITS ? sizeof(rf_msg_text_credits_t)	\
+								: (msg_type) == MT_HOST_STATE ? sizeof(rf_msg_host_state_t)		\
+								: 0)
+
+#define MAX_PAYLOAD			32		// the longest payload the nRF takes
+#define MAX_ACK_PAYLOAD		32
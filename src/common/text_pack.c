@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "rf_protocol.h"
+#include "text_templates.h"
+#include "text_pack.h"
+
+// writes the 6-bit code at the bit position of the packed text; MSB first
+static void pack_code(uint8_t* out, uint16_t bitpos, uint8_t code)
+{
+	const uint16_t window = (uint16_t) code << (10 - (bitpos & 7));
+
+	out[bitpos >> 3] |= window >> 8;
+	if (window & 0xff)
+		out[(bitpos >> 3) + 1] |= window & 0xff;
+}
+
+uint8_t text_pack(const char* text, uint8_t len, uint8_t* out, uint8_t* packed_bytes, uint8_t* ring_bytes)
+{
+	uint16_t bitpos = 0;
+	uint8_t ndx = 0;
+	uint8_t ring = 0;
+
+	memset(out, 0, MAX_TEXT_LEN);		// TP_END is 0
+
+	while (ndx < len)
+	{
+		uint8_t codes[10];		// the codes of one char, word or number; a number has up to 10 digits
+		uint8_t num_codes = 1;
+		uint8_t unit_len = 1;
+		uint8_t unit_ring = 1;
+		const uint8_t c = text[ndx];
+
+		// the dictionary words first
+		uint8_t d;
+		for (d = 0; d < TP_DICT_COUNT; ++d)
+		{
+			__FLASH_ATTR const char* word = text_pack_dict[d];
+			uint8_t wlen = 0;
+			while (word[wlen]  &&  ndx + wlen < len  &&  word[wlen] == text[ndx + wlen])
+				++wlen;
+
+			if (word[wlen] == '\0')
+			{
+				codes[0] = TP_DICT_FIRST + d;
+				unit_len = unit_ring = wlen;
+				break;
+			}
+		}
+
+		if (d < TP_DICT_COUNT)
+		{
+			// found a word
+		} else if (c >= 'a'  &&  c <= 'z') {
+			codes[0] = TP_LETTER_FIRST + c - 'a';
+		} else if (c >= 'A'  &&  c <= 'Z') {
+			codes[0] = TP_UPPER;
+			codes[1] = TP_LETTER_FIRST + c - 'A';
+			num_codes = 2;
+		} else if (c >= '0'  &&  c <= '9') {
+			codes[0] = TP_DIGIT_FIRST + c - '0';
+		} else if (IS_TT_NUMBER(c)) {
+
+			uint32_t num = 0;
+			uint8_t shift = 0;
+			const uint8_t cnt = TT_NUMBER_BYTES(c);
+			for (d = 1; d <= cnt; ++d)
+			{
+				num |= (uint32_t)(text[ndx + d] & 0x7f) << shift;
+				shift += 7;
+			}
+
+			unit_len += cnt;
+
+			// the digits go in backwards
+			num_codes = 0;
+			do {
+				codes[num_codes++] = TP_DIGIT_FIRST + num % 10;
+				num /= 10;
+			} while (num);
+
+			for (d = 0; d < num_codes / 2; ++d)
+			{
+				const uint8_t tmp = codes[d];
+				codes[d] = codes[num_codes - 1 - d];
+				codes[num_codes - 1 - d] = tmp;
+			}
+
+			unit_ring = num_codes;
+
+		} else {
+
+			__FLASH_ATTR const char* punct = text_pack_punct;
+			while (punct < text_pack_punct + TP_PUNCT_COUNT  &&  *punct != c)
+				++punct;
+
+			if (punct < text_pack_punct + TP_PUNCT_COUNT)
+			{
+				codes[0] = TP_PUNCT_FIRST + (punct - text_pack_punct);
+			} else {
+				// the template tokens and everything else
+				codes[0] = TP_RAW;
+				codes[1] = c >> 6;
+				codes[2] = c & 0x3f;
+				num_codes = 3;
+			}
+		}
+
+		// stop if the codes don't fit, or if the dongle would need more credits than a plain
+		// message ever does; the dongle's buffer has to be able to take the text at once
+		if (bitpos + num_codes * TP_CODE_BITS > MAX_TEXT_LEN * 8  ||  ring + unit_ring > MAX_TEXT_LEN * 2)
+			break;
+
+		for (d = 0; d < num_codes; ++d)
+		{
+			pack_code(out, bitpos, codes[d]);
+			bitpos += TP_CODE_BITS;
+		}
+
+		ndx += unit_len;
+		ring += unit_ring;
+	}
+
+	*packed_bytes = (bitpos + 7) / 8;
+	*ring_bytes = ring;
+
+	return ndx;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tgtdefs.h"
+
+// Packs the text into the codes of MT_TEXT_PACKED (see text_templates.h) until
+// the packed message is full. The number tokens are unpacked to digits, and are
+// never split. Returns the number of text bytes packed, the size of the packed
+// message in packed_bytes and the number of chars it unpacks to in ring_bytes.
+uint8_t text_pack(const char* text, uint8_t len, uint8_t* out, uint8_t* packed_bytes, uint8_t* ring_bytes);
@@ -0,0 +1,90 @@
+#include <stdint.h>
+
+#include "text_templates.h"
+
+static __FLASH_ATTR const char tt_menu_header[]			= "7G wireless\nfirmware build ";
+static __FLASH_ATTR const char tt_battery[]				= "\nbattery voltage: ";
+static __FLASH_ATTR const char tt_rf_stats[]			= "\nRF packet stats (total/retransmit/lost): ";
+static __FLASH_ATTR const char tt_airtime[]				= "\nRF airtime per key event: ";
+static __FLASH_ATTR const char tt_throughput[]			= "\ntext throughput: ";
+static __FLASH_ATTR const char tt_chars_per_sec[]		= " chars/s";
+static __FLASH_ATTR const char tt_text_bytes[]			= "\ntext over RF (payload bytes/chars typed): ";
+static __FLASH_ATTR const char tt_key_reports[]			= "\nkey reports (merged/suppressed): ";
+static __FLASH_ATTR const char tt_keep_warm[]			= "\nradio keep-warm (hits/timeouts/cold starts): ";
+static __FLASH_ATTR const char tt_tx_wait[]				= "\nTX wait (wakeups/packets, avg per packet): ";
+static __FLASH_ATTR const char tt_microseconds[]		= "us";
+static __FLASH_ATTR const char tt_uptime[]				= "\nkeyboard's been on for ";
+static __FLASH_ATTR const char tt_days[]				= " days ";
+static __FLASH_ATTR const char tt_hours[]				= " hours ";
+static __FLASH_ATTR const char tt_minutes[]				= " minutes ";
+static __FLASH_ATTR const char tt_seconds[]				= " seconds\n";
+static __FLASH_ATTR const char tt_menu_power[]			= "\n\nwhat do you want to do?\n"
+														  "F1 - change transmitter output power (current ";
+static __FLASH_ATTR const char tt_menu_brightness[]		= "dBm)\nF2 - change LED brightness (current ";
+static __FLASH_ATTR const char tt_menu_other[]			= ")\nF3 - lock keyboard (unlock with Func+Del+LCtrl)\n"
+														  "F4 - reset RF packet stats\n"
+														  "F5 - refresh this menu\n"
+														  "F6 - calibrate internal RC oscillator (OSCCAL=";
+static __FLASH_ATTR const char tt_menu_esc[]			= ")\nEsc - exit menu\n\n";
+static __FLASH_ATTR const char tt_select_power[]		= "select power:\nF1 0dBm\nF2 -6dBm\nF3 -12dBm\nF4 -18dBm\n";
+static __FLASH_ATTR const char tt_select_brightness[]	= "press F1 (dimmest) to F12 (brightest) for brightness, Esc to finish\n";
+static __FLASH_ATTR const char tt_locked[]				= "Keyboard is now LOCKED!!!\nPress Func+Del+LCtrl to unlock\n\n";
+static __FLASH_ATTR const char tt_exit_menu[]			= "\nexiting menu, you can type now\n";
+static __FLASH_ATTR const char tt_text_msgs[]			= "\ntext messages (packed/total): ";
+static __FLASH_ATTR const char tt_reg_cache[]			= "\nnRF register cache (SPI bytes saved per key event/last menu): ";
+static __FLASH_ATTR const char tt_scan_to_air[]			= "\nkey change to ACK (avg): ";
+
+__FLASH_ATTR const char* const __FLASH_ATTR text_templates[TT_COUNT] =
+{
+	tt_menu_header,			// TT_MENU_HEADER
+	tt_battery,				// TT_BATTERY
+	tt_rf_stats,			// TT_RF_STATS
+	tt_airtime,				// TT_AIRTIME
+	tt_throughput,			// TT_THROUGHPUT
+	tt_chars_per_sec,		// TT_CHARS_PER_SEC
+	tt_text_bytes,			// TT_TEXT_BYTES
+	tt_key_reports,			// TT_KEY_REPORTS
+	tt_keep_warm,			// TT_KEEP_WARM
+	tt_tx_wait,				// TT_TX_WAIT
+	tt_microseconds,		// TT_MICROSECONDS
+	tt_uptime,				// TT_UPTIME
+	tt_days,				// TT_DAYS
+	tt_hours,				// TT_HOURS
+	tt_minutes,				// TT_MINUTES
+	tt_seconds,				// TT_SECONDS
+	tt_menu_power,			// TT_MENU_POWER
+	tt_menu_brightness,		// TT_MENU_BRIGHTNESS
+	tt_menu_other,			// TT_MENU_OTHER
+	tt_menu_esc,			// TT_MENU_ESC
+	tt_select_power,		// TT_SELECT_POWER
+	tt_select_brightness,	// TT_SELECT_BRIGHTNESS
+	tt_locked,				// TT_LOCKED
+	tt_exit_menu,			// TT_EXIT_MENU
+	tt_text_msgs,			// TT_TEXT_MSGS
+	tt_reg_cache,			// TT_REG_CACHE
+	tt_scan_to_air,			// TT_SCAN_TO_AIR
+};
+
+// the punctuation of the packed text encoding
+__FLASH_ATTR const char text_pack_punct[TP_PUNCT_COUNT] = {' ', '\n', '.', ',', ':', '/', '(', ')', '-', '=', '+', '\'', '!'};
+
+// The frequent tokens of the packed text encoding. The keyboard tries to match
+// them in this order, so the longer ones should be first.
+static __FLASH_ATTR const char tp_power[]	= "power";
+static __FLASH_ATTR const char tp_menu[]	= "menu";
+static __FLASH_ATTR const char tp_the[]		= "the ";
+static __FLASH_ATTR const char tp_key[]		= "key";
+static __FLASH_ATTR const char tp_dbm[]		= "dBm";
+static __FLASH_ATTR const char tp_rf[]		= "RF ";
+static __FLASH_ATTR const char tp_esc[]		= "Esc";
+static __FLASH_ATTR const char tp_dash[]	= " - ";
+static __FLASH_ATTR const char tp_ing[]		= "ing";
+static __FLASH_ATTR const char tp_ed[]		= "ed ";
+static __FLASH_ATTR const char tp_er[]		= "er";
+static __FLASH_ATTR const char tp_on[]		= "on";
+
+__FLASH_ATTR const char* const __FLASH_ATTR text_pack_dict[TP_DICT_COUNT] =
+{
+	tp_power, tp_menu, tp_the, tp_key, tp_dbm, tp_rf,
+	tp_esc, tp_dash, tp_ing, tp_ed, tp_er, tp_on,
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tgtdefs.h"
+
+// The fixed strings of the keyboard menu. The dongle keeps them in its code memory,
+// so the keyboard sends a one byte token instead of the entire string, and the
+// dongle expands the token when it types the text out.
+//
+// Bump TEXT_TEMPLATES_VERSION on every change of the tables in this file. The dongle sends
+// its version with the text credits, and the keyboard sends plain text if the versions differ.
+//
+// version 1: the templates
+// version 2: adds the packed text encoding (MT_TEXT_PACKED)
+// version 3: adds TT_REG_CACHE
+// version 4: adds TT_SCAN_TO_AIR
+#define TEXT_TEMPLATES_VERSION	4
+
+// the text bytes with the high bit set are tokens; char2keycode maps only 7-bit ASCII
+#define IS_TEXT_TOKEN(c)		((uint8_t)(c) & 0x80)
+
+// the template tokens are TT_FIRST + the index in text_templates[]
+#define TT_FIRST				0x80
+#define IS_TT_TEMPLATE(c)		((uint8_t)(c) >= TT_FIRST  &&  (uint8_t)(c) < TT_FIRST + TT_COUNT)
+
+// A packed number token is followed by 1 to 5 bytes with 7 bits of the number each,
+// least significant first and with the high bit set, so the text never contains a zero.
+// The keyboard never splits a packed number between two text messages.
+#define TT_NUMBER_FIRST			0xf0		// + the number of bytes that follow - 1
+#define TT_NUMBER_MAX_BYTES		5
+#define IS_TT_NUMBER(c)			((uint8_t)(c) >= TT_NUMBER_FIRST  &&  (uint8_t)(c) < TT_NUMBER_FIRST + TT_NUMBER_MAX_BYTES)
+#define TT_NUMBER_BYTES(c)		((uint8_t)(c) - TT_NUMBER_FIRST + 1)
+
+// the template tokens as strings, so they can be used in string literals
+// these have to be in the same order as text_templates[]
+#define TT_MENU_HEADER			"\x80"
+#define TT_BATTERY				"\x81"
+#define TT_RF_STATS				"\x82"
+#define TT_AIRTIME				"\x83"
+#define TT_THROUGHPUT			"\x84"
+#define TT_CHARS_PER_SEC		"\x85"
+#define TT_TEXT_BYTES			"\x86"
+#define TT_KEY_REPORTS			"\x87"
+#define TT_KEEP_WARM			"\x88"
+#define TT_TX_WAIT				"\x89"
+#define TT_MICROSECONDS			"\x8a"
+#define TT_UPTIME				"\x8b"
+#define TT_DAYS					"\x8c"
+#define TT_HOURS				"\x8d"
+#define TT_MINUTES				"\x8e"
+#define TT_SECONDS				"\x8f"
+#define TT_MENU_POWER			"\x90"
+#define TT_MENU_BRIGHTNESS		"\x91"
+#define TT_MENU_OTHER			"\x92"
+#define TT_MENU_ESC				"\x93"
+#define TT_SELECT_POWER			"\x94"
+#define TT_SELECT_BRIGHTNESS	"\x95"
+#define TT_LOCKED				"\x96"
+#define TT_EXIT_MENU			"\x97"
+#define TT_TEXT_MSGS			"\x98"
+#define TT_REG_CACHE			"\x99"
+#define TT_SCAN_TO_AIR			"\x9a"
+
+#define TT_COUNT				27
+
+extern __FLASH_ATTR const char* const __FLASH_ATTR text_templates[TT_COUNT];
+
+// The packed text encoding: the text of an MT_TEXT_PACKED message is a stream of 6-bit
+// codes, most significant bit first. The packed numbers are sent as digits.
+#define TP_END				0		// end of the text; also pads the last byte
+#define TP_LETTER_FIRST		1		// + 0 for 'a' ... 25 for 'z'
+#define TP_DIGIT_FIRST		27		// + 0 for '0' ... 9 for '9'
+#define TP_PUNCT_FIRST		37		// + the index in text_pack_punct[]
+#define TP_DICT_FIRST		50		// + the index in text_pack_dict[]
+#define TP_UPPER			62		// the next code is a letter in upper case
+#define TP_RAW				63		// the next two codes are a raw byte: the top 2 bits, then the rest
+
+#define TP_CODE_BITS		6
+#define TP_PUNCT_COUNT		13
+#define TP_DICT_COUNT		12
+
+extern __FLASH_ATTR const char text_pack_punct[TP_PUNCT_COUNT];
+extern __FLASH_ATTR const char* const __FLASH_ATTR text_pack_dict[TP_DICT_COUNT];
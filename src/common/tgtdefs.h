@@ -11,6 +11,15 @@
 #	define __xdata
 #	define __code
 #	define memcpy_X(dst, src, cnt)	memcpy(dst, src, cnt)
+#elif defined(HOST_BUILD)
+	// the MCU independent code (like the dongle core) built natively for benchmarking
+#	include <string.h>
+#	define __FLASH_ATTR
+#	define __xdata
+#	define __code
+#	define _BV(b)			(1 << (b))
+#	define memcpy_X(dst, src, cnt)	memcpy(dst, src, cnt)
+#	define memcpy_P(dst, src, cnt)	memcpy(dst, src, cnt)
 #else
 #	ifdef NRF24LE1
 #		include <reg24le1.h>
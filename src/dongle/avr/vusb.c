@@ -15,10 +15,12 @@
 #include "rf_protocol.h"
 #include "hw_setup.h"
 #include "reports.h"
+#include "dongle_core.h"
 #include "avrutils.h"
 
-uint8_t vusb_idle_rate;				// in 4 ms units - set by SET_IDLE
-uint8_t vusb_idle_counter;
+// the idle rates and the time left to the next resend of every interface
+uint8_t vusb_idle_rate[USB_NUM_IFACES];		// in 4 ms units - set by SET_IDLE
+uint8_t vusb_idle_counter[USB_NUM_IFACES];
 
 uint8_t vusb_curr_protocol;			// this one's a little pointless because in our case both the boot
 									// protocol and the report protocol are the same, but we'll support
@@ -213,7 +215,7 @@ void vusb_init(void)
 	_delay_ms(260);			// fake USB disconnect for > 250 ms
 	usbDeviceConnect();
 
-	vusb_idle_rate = 0;
+	vusb_idle_rate[USB_IFACE_KEYBOARD] = vusb_idle_rate[USB_IFACE_CONSUMER] = 0;
 	vusb_curr_protocol = 1;	// report protocol
 	
 	// clear the reports
@@ -221,37 +223,72 @@ void vusb_init(void)
 	reset_keyboard_report();
 }
 
-bool vusb_poll(void)
+void vusb_poll(void)
 {
+	uint8_t i;
+
 	usbPoll();
 
-	bool ret_val = false;
-	
-	// take care of the idle rate
-	if (vusb_idle_rate  &&  (TIFR0  &  _BV(TOV0)))		// timer overflow?
+	// the timer overflow counts down all the interfaces; the main loop comes
+	// here much more often than every 22ms, so we don't miss an overflow
+	if (TIFR0  &  _BV(TOV0))
 	{
 		TIFR0 = _BV(TOV0);
 
-		if (vusb_idle_rate != 0)
+		for (i = 0; i < USB_NUM_IFACES; ++i)
 		{
-			if (vusb_idle_counter > 4)
-			{
-				vusb_idle_counter -= 5;	// 22 ms in units of 4 ms
-			} else {
-				vusb_idle_counter = vusb_idle_rate;
-				ret_val = true;
-			}
+			if (vusb_idle_counter[i] > 4)
+				vusb_idle_counter[i] -= 5;	// 22 ms in units of 4 ms
+			else
+				vusb_idle_counter[i] = 0;
 		}
 	}
-	
-	return ret_val;
 }
 
-void vusb_reset_idle(void)
+bool usb_idle_elapsed(uint8_t iface)
+{
+	return vusb_idle_rate[iface] != 0  &&  vusb_idle_counter[iface] == 0;
+}
+
+void vusb_reset_idle(uint8_t iface)
+{
+	vusb_idle_counter[iface] = vusb_idle_rate[iface];
+}
+
+bool usb_kbd_ep_ready(void)
+{
+	return usbInterruptIsReady();
+}
+
+void usb_kbd_ep_send(const hid_kbd_report_t* report)
+{
+	usbSetInterrupt((void*) report, sizeof(hid_kbd_report_t));
+	vusb_reset_idle(USB_IFACE_KEYBOARD);
+}
+
+bool usb_consumer_ep_ready(void)
+{
+	return usbInterruptIsReady3();
+}
+
+void usb_consumer_ep_send(uint8_t report)
+{
+	usbSetInterrupt3(&report, sizeof report);
+	vusb_reset_idle(USB_IFACE_CONSUMER);
+}
+
+// V-USB doesn't tell us about the suspend, and the descriptors don't offer remote wakeup
+bool usb_is_suspended(void)
+{
+	return false;
+}
+
+void usb_remote_wakeup(void)
+{}
+
+bool usb_can_wake_host(void)
 {
-	vusb_idle_counter = vusb_idle_rate;
-	TIFR0 = _BV(TOV0);
-	TCNT0 = 0;
+	return false;
 }
 
 uchar usbFunctionSetup(uchar data[8])
@@ -274,14 +311,16 @@ uchar usbFunctionSetup(uchar data[8])
 				return 1;
 			}
 
-		} else if (rq->bRequest == USBRQ_HID_GET_IDLE) {
+		} else if (rq->bRequest == USBRQ_HID_GET_IDLE  &&  rq->wIndex.word < USB_NUM_IFACES) {
 
-            usbMsgPtr = (usbMsgPtr_t) &vusb_idle_rate;
+            usbMsgPtr = (usbMsgPtr_t) &vusb_idle_rate[rq->wIndex.word];
             return 1;
 			
-        } else if (rq->bRequest == USBRQ_HID_SET_IDLE) {
+        } else if (rq->bRequest == USBRQ_HID_SET_IDLE  &&  rq->wIndex.word < USB_NUM_IFACES) {
 
-            vusb_idle_rate = rq->wValue.bytes[1];
+			// one report per interface, so the report ID in wValue.bytes[0] doesn't matter
+            vusb_idle_rate[rq->wIndex.word] = rq->wValue.bytes[1];
+			vusb_reset_idle(rq->wIndex.word);
 			
         } else if(rq->bRequest == USBRQ_HID_SET_REPORT) {
 
@@ -324,8 +363,8 @@ uchar usbFunctionWrite(uchar *data, uchar len)
 						| ((data[0] & 2) ? 4 : 0)
 						| ((data[0] & 4) ? 2 : 0);
 
-	// queue the status which will be sent with the next ACK payload
-	rf_dngl_queue_ack_payload(&msg, sizeof msg);
+	// queue the status for all the keyboards; it's sent with the next ACK payload
+	rf_dngl_queue_ack_payload(&msg, sizeof msg, RF_ALL_PIPES);
 
 	vusb_expect_data = 0;
 
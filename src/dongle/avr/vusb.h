@@ -4,5 +4,5 @@
 
 void vusb_init(void);
 
-bool vusb_poll(void);			// returns true if the idle duration has expired
-void vusb_reset_idle(void);		// resets the idle duration
+void vusb_poll(void);
+void vusb_reset_idle(uint8_t iface);		// restarts the idle duration of the interface
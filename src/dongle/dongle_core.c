@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dongle_core.h"
+#include "reports.h"
+#include "rf_protocol.h"
+#include "rf_dngl.h"
+
+// the message handlers; the length of the message has been checked already
+typedef void (*msg_handler_t)(__xdata const rf_rx_packet_t* packet);
+
+static void handle_key_state(__xdata const rf_rx_packet_t* packet)
+{
+	process_key_state_msg(packet->payload, packet->bytes, packet->pipe);
+}
+
+static void handle_key_events(__xdata const rf_rx_packet_t* packet)
+{
+	process_key_events_msg(packet->payload, packet->bytes, packet->pipe);
+}
+
+static void handle_text(__xdata const rf_rx_packet_t* packet)
+{
+	process_text_msg(packet->payload, packet->bytes, packet->pipe);
+}
+
+typedef struct
+{
+	uint8_t			min_bytes;
+	uint8_t			max_bytes;
+	msg_handler_t	handler;
+} msg_dispatch_t;
+
+// The handlers and the valid lengths of the messages, indexed by the message type.
+// The ACK payload messages only go to the keyboard, so they have no handler.
+static __FLASH_ATTR const msg_dispatch_t msg_dispatch[] =
+{
+	{0, 0, NULL},																// 0
+	{3, sizeof(rf_msg_key_state_report_t), handle_key_state},					// MT_KEY_STATE
+	{2, sizeof(rf_msg_text_t), handle_text},									// MT_TEXT
+	{0, 0, NULL},																// MT_LED_STATUS
+	{0, 0, NULL},																// MT_TEXT_CREDITS
+	{2, sizeof(rf_msg_key_events_t), handle_key_events},						// MT_KEY_EVENTS
+	{2, sizeof(rf_msg_text_t), handle_text},									// MT_TEXT_PACKED
+	{0, 0, NULL},																// MT_HOST_STATE
+};
+
+#define MSG_DISPATCH_COUNT	(sizeof msg_dispatch / sizeof msg_dispatch[0])
+
+bool host_suspended = false;	// the host state the keyboards have been told about
+
+// tells the keyboards the host has suspended or resumed, and duty cycles the receiver
+static void update_host_state(const bool suspended)
+{
+	__xdata rf_msg_host_state_t msg;
+
+	host_suspended = suspended;
+
+	msg.msg_type = MT_HOST_STATE;
+	msg.host_state = suspended ? HOST_SUSPENDED : 0;
+	rf_dngl_queue_ack_payload(&msg, sizeof msg, RF_ALL_PIPES);
+
+	if (suspended)
+	{
+		rf_dngl_suspend(usb_can_wake_host());
+	} else {
+		rf_dngl_resume();
+
+		// the keystrokes from before the suspend are stale by now
+		collapse_report_queues();
+	}
+}
+
+void dongle_poll(void)
+{
+	__xdata rf_rx_packet_t* packet;
+	__FLASH_ATTR const msg_dispatch_t* dispatch;
+
+	// get the next packet the RF interrupt has received
+	packet = rf_dngl_recv();
+
+	if (packet)
+	{
+		// drop the unknown messages and the ones with a bad length
+		if (packet->payload[0] < MSG_DISPATCH_COUNT)
+		{
+			dispatch = &msg_dispatch[packet->payload[0]];
+			if (dispatch->handler  &&  packet->bytes >= dispatch->min_bytes  &&  packet->bytes <= dispatch->max_bytes)
+				dispatch->handler(packet);
+		}
+
+		rf_dngl_release();
+	}
+
+	if (usb_is_suspended() != host_suspended)
+		update_host_state(!host_suspended);
+
+	// Nothing is queued while the host is suspended, a key only wakes it up. The key state
+	// is queued after the resume, and the text carries on from where it was.
+	if (host_suspended)
+	{
+		if (is_key_state_changed()  ||  is_consumer_report_queued())
+			usb_remote_wakeup();
+
+		return;
+	}
+
+	// queue the key state or the next keys of the text
+	arbitrate_reports();
+
+	// send the next queued keyboard report if the endpoint is not busy
+	if (usb_kbd_ep_ready()  &&  (is_keyboard_report_queued()  ||  usb_idle_elapsed(USB_IFACE_KEYBOARD)))
+		usb_kbd_ep_send(pop_keyboard_report());
+
+	// and the audio and media controls report
+	if (usb_consumer_ep_ready()  &&  (is_consumer_report_queued()  ||  usb_idle_elapsed(USB_IFACE_CONSUMER)))
+		usb_consumer_ep_send(pop_consumer_report());
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tgtdefs.h"
+#include "reports.h"
+
+// The part of the dongle that doesn't depend on the MCU: the RF message dispatch, the
+// report queues and the text typing. Both dongles call dongle_poll() from their main loops.
+void dongle_poll(void);
+
+// The USB endpoints as the core sees them, implemented by usb.c (nRF24LU1) and vusb.c (V-USB).
+bool usb_kbd_ep_ready(void);
+void usb_kbd_ep_send(__xdata const hid_kbd_report_t* report);
+bool usb_consumer_ep_ready(void);
+void usb_consumer_ep_send(uint8_t report);
+
+// the HID interfaces of both dongles
+#define USB_IFACE_KEYBOARD		0
+#define USB_IFACE_CONSUMER		1
+#define USB_NUM_IFACES			2
+
+// True when the interface's HID idle duration has passed since its last report; its
+// endpoint resends the last report then. Always false with an idle rate of 0 (forever).
+// Sending a report on the endpoint restarts the interface's idle duration.
+bool usb_idle_elapsed(uint8_t iface);
+
+// true while the host has the bus suspended
+bool usb_is_suspended(void);
+// signals a remote wakeup if the host has enabled it, once per suspend
+void usb_remote_wakeup(void);
+// true if the host has enabled the remote wakeup (SET_FEATURE(DEVICE_REMOTE_WAKEUP))
+bool usb_can_wake_host(void);
@@ -0,0 +1,75 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_stubs.h"
+#include "rf_protocol.h"
+
+// Feeds dongle_poll() packets of random types, lengths and contents from random pipes,
+// with the endpoints randomly busy and the host randomly suspending. Every packet is
+// allocated with only its received bytes, so a sanitizer build (see the makefile)
+// catches a handler that reads past the message.
+// The text messages are the only ones that always queue an ACK payload, so they also
+// check that the dispatch takes the lengths it should and drops the others.
+
+#define FUZZ_PACKETS	1000000
+
+int main(void)
+{
+	rf_rx_packet_t* packet;
+	uint32_t acks, bad = 0;
+	uint8_t bytes, type, b;
+	long cnt;
+	bool dispatched, was_suspended = false;
+
+	srand(1);
+
+	for (cnt = 0; cnt < FUZZ_PACKETS; cnt++)
+	{
+		bytes = rand() % (MAX_PAYLOAD + 2);
+		type = rand() % (MT_HOST_STATE + 2);
+
+		packet = malloc(offsetof(rf_rx_packet_t, payload) + (bytes ? bytes : 1));
+		packet->bytes = bytes;
+		packet->pipe = rand() % RF_NUM_PIPES;
+		packet->payload[0] = type;
+		for (b = 1; b < bytes; b++)
+			packet->payload[b] = rand();
+
+		stub_kbd_ep_busy = rand() & 1;
+		stub_idle_elapsed = (rand() & 7) == 0;
+		was_suspended = stub_usb_suspended;
+		stub_usb_suspended = (rand() & 63) == 0;
+
+		acks = stub_ack_payloads;
+		stub_rx_packet = packet;
+		dongle_poll();
+		dongle_poll();
+
+		if (stub_rx_packet)
+		{
+			printf("dispatch_fuzz: the packet hasn't been released\n");
+			return 1;
+		}
+
+		// the host state change queues an ACK payload of its own, so skip those
+		if ((type == MT_TEXT  ||  type == MT_TEXT_PACKED)  &&  stub_usb_suspended == was_suspended)
+		{
+			dispatched = stub_ack_payloads != acks;
+			if (dispatched != (bytes >= 2  &&  bytes <= sizeof(rf_msg_text_t)))
+				++bad;
+		}
+
+		free(packet);
+	}
+
+	if (bad)
+	{
+		printf("dispatch_fuzz: %u text messages with the wrong dispatch\n", bad);
+		return 1;
+	}
+
+	printf("dispatch_fuzz: %u packets, %u keyboard reports\n", FUZZ_PACKETS, stub_kbd_reports);
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "host_stubs.h"
+#include "text_message.h"
+#include "rf_protocol.h"
+
+// Compares the text flow control of the keyboard's send_text() with the two schemes
+// it replaced, on the real dongle core with the time model of host_stubs.h: the air
+// time of every packet, the ACK payload one packet late, the ~10ms sleep_ticks(40)
+// of the keyboard, and a host that polls the keyboard endpoint every 1 or 10ms.
+// The chars/s count from the first packet until the host has the last report,
+// including the wait for the dongle's buffer to empty (wait_for_finish).
+//
+//   stop-and-wait	the original: a probe for the free space before every chunk
+//   free window	sends while the free space the dongle reported, less the chunks
+//					it may not have counted yet, leaves room (MT_TEXT_BUFF_FREE)
+//   credits		the current one (MT_TEXT_CREDITS, see rf_protocol.h)
+//
+// The old schemes get the free space the old dongle sent in MT_TEXT_BUFF_FREE:
+// msg_free() after the packet. All of them send plain MT_TEXT chunks. Every scheme
+// sends the text twice and the second time is measured, so it starts with the ACK
+// payload the first one left in the dongle, like a menu that isn't the first.
+
+#define SLEEP_US	(40 * 244)		// sleep_ticks(40) on the keyboard
+
+static char test_text[800];
+static uint16_t test_len;
+
+static char typed[sizeof test_text * 2];
+static uint16_t typed_len;
+
+static hid_kbd_report_t prev_report;
+
+// the char for each keycode and modifiers combination
+static char keycode2char[256][256];
+
+// what the keyboard knows from the ACK payloads
+static int16_t old_free_queued = -1;	// what the old dongle would have queued, -1 for nothing
+static uint8_t old_free;
+static uint8_t credit_limit;
+static bool typed_out, ignore_credits;
+static bool credits_probed;
+
+static uint32_t packets;
+
+static bool is_key_in(const uint8_t* keys, uint8_t keycode)
+{
+	uint8_t c;
+	for (c = 0; c < TYPING_MAX_KEYS; c++)
+		if (keys[c] == keycode)
+			return true;
+
+	return false;
+}
+
+static void on_kbd_report(const hid_kbd_report_t* report)
+{
+	uint8_t c;
+	for (c = 0; c < TYPING_MAX_KEYS; c++)
+	{
+		if (report->keys[c]  &&  !is_key_in(prev_report.keys, report->keys[c])
+				&&  typed_len < sizeof typed)
+			typed[typed_len++] = keycode2char[report->modifiers][report->keys[c]];
+	}
+
+	prev_report = *report;
+}
+
+static void send_msg(const rf_msg_text_t* msg, uint8_t bytes)
+{
+	uint8_t ack[MAX_ACK_PAYLOAD];
+	const rf_msg_text_credits_t* msg_credits = (const rf_msg_text_credits_t*) ack;
+
+	++packets;
+	if (stub_send(0, (const uint8_t*) msg, bytes, ack) >= sizeof(rf_msg_text_credits_t)
+			&&  msg_credits->msg_type == MT_TEXT_CREDITS  &&  !ignore_credits)
+	{
+		if ((int8_t)(msg_credits->credit_limit - credit_limit) > 0)
+			credit_limit = msg_credits->credit_limit;
+
+		typed_out = msg_credits->typed_out;
+	}
+
+	if (old_free_queued >= 0)
+		old_free = old_free_queued;
+
+	old_free_queued = msg_free();
+}
+
+static void stop_and_wait(const char* text, uint16_t len)
+{
+	static rf_msg_text_t msg = {MT_TEXT, 1};
+	uint8_t chunk;
+
+	while (len)
+	{
+		chunk = len < MAX_TEXT_LEN ? len : MAX_TEXT_LEN;
+
+		for (;;)
+		{
+			send_msg(&msg, 2);
+			if (old_free > chunk + 1)
+				break;
+
+			stub_wait(SLEEP_US);
+		}
+
+		msg.msg_id = msg.msg_id == 0xff ? 1 : msg.msg_id + 1;
+		memcpy(msg.text, text, chunk);
+		send_msg(&msg, chunk + 2);
+
+		text += chunk;
+		len -= chunk;
+	}
+
+	do {
+		send_msg(&msg, 2);
+	} while (old_free != msg_capacity());
+}
+
+static void free_window(const char* text, uint16_t len)
+{
+	static rf_msg_text_t msg = {MT_TEXT, 1};
+	int16_t budget = 0;
+	uint8_t chunk, last_delivered = 0;
+
+	while (len)
+	{
+		chunk = len < MAX_TEXT_LEN ? len : MAX_TEXT_LEN;
+
+		while (budget < chunk + 1)
+		{
+			send_msg(&msg, 2);
+			budget = old_free - last_delivered;
+			if (budget < chunk + 1)
+				stub_wait(SLEEP_US);
+		}
+
+		msg.msg_id = msg.msg_id == 0xff ? 1 : msg.msg_id + 1;
+		memcpy(msg.text, text, chunk);
+		budget -= chunk + 1;
+		send_msg(&msg, chunk + 2);
+
+		// the chunk is delivered, and then the ACK payload is in
+		last_delivered = chunk + 1;
+		budget = old_free - last_delivered;
+
+		text += chunk;
+		len -= chunk;
+	}
+
+	do {
+		send_msg(&msg, 2);
+	} while (old_free != msg_capacity());
+}
+
+static void credits(const char* text, uint16_t len)
+{
+	static rf_msg_text_t msg = {MT_TEXT, 0};
+	static uint8_t sent = 0;
+	uint8_t chunk;
+
+	// The probe of the first text after a reset. The credits the other schemes have left
+	// in the ACK payload were given for their msg_ids, so the keyboard can't take them.
+	if (!credits_probed)
+	{
+		credit_limit = sent;
+		msg.msg_id = sent;
+		ignore_credits = true;
+		send_msg(&msg, 2);
+		ignore_credits = false;
+		credits_probed = true;
+	}
+
+	while (len)
+	{
+		chunk = len < MAX_TEXT_LEN ? len : MAX_TEXT_LEN;
+
+		while ((uint8_t)(credit_limit - sent) < chunk + 1)
+		{
+			msg.msg_id = sent;
+			send_msg(&msg, 2);
+			if ((uint8_t)(credit_limit - sent) < chunk + 1)
+				stub_wait(SLEEP_US);
+		}
+
+		msg.msg_id = sent;
+		memcpy(msg.text, text, chunk);
+		sent += chunk + 1;
+		send_msg(&msg, chunk + 2);
+
+		text += chunk;
+		len -= chunk;
+	}
+
+	msg.msg_id = sent;
+	typed_out = false;
+	for (;;)
+	{
+		send_msg(&msg, 2);
+		if (typed_out)
+			break;
+
+		stub_wait(SLEEP_US);
+	}
+}
+
+// returns chars/s and the packets of the second run, or 0 if the text didn't come out right
+static uint32_t measure(void (*send_text)(const char* text, uint16_t len), uint32_t poll_us, uint32_t* num_packets)
+{
+	uint32_t started;
+	uint8_t run;
+
+	stub_poll_us = poll_us;
+	credits_probed = false;
+
+	for (run = 0; run < 2; run++)
+	{
+		typed_len = 0;
+		started = stub_now_us;
+		packets = 0;
+
+		send_text(test_text, test_len);
+
+		// the host takes the last reports
+		while (stub_kbd_ep_busy  ||  is_keyboard_report_queued())
+			stub_wait(poll_us);
+
+		if (typed_len != test_len  ||  memcmp(typed, test_text, test_len) != 0)
+			return 0;
+	}
+
+	*num_packets = packets;
+
+	return (uint64_t) test_len * 1000000 / (stub_now_us - started);
+}
+
+int main(void)
+{
+	static const uint32_t poll_intervals[] = {1000, 10000};
+	uint32_t saw, window, cred;
+	uint32_t saw_packets, window_packets, cred_packets;
+	uint8_t p;
+	int c;
+
+	// a menu sized text
+	while (test_len + 100 < sizeof test_text)
+		test_len += sprintf(test_text + test_len, "%u: The quick brown fox jumps over the lazy dog. ", test_len);
+
+	for (c = ' '; c < 0x7f; c++)
+		keycode2char[get_modifiers_for_char(c)][get_keycode_for_char(c)] = c;
+
+	stub_on_kbd_report = on_kbd_report;
+
+	for (p = 0; p < sizeof poll_intervals / sizeof poll_intervals[0]; p++)
+	{
+		saw = measure(stop_and_wait, poll_intervals[p], &saw_packets);
+		window = measure(free_window, poll_intervals[p], &window_packets);
+		cred = measure(credits, poll_intervals[p], &cred_packets);
+
+		if (saw == 0  ||  window == 0  ||  cred == 0)
+		{
+			printf("flow_sim: the text didn't come out right\n");
+			return 1;
+		}
+
+		printf("flow_sim: %u chars, host poll %2ums: stop-and-wait %u chars/s in %u packets, "
+					"free window %u in %u, credits %u in %u\n", test_len, poll_intervals[p] / 1000,
+					saw, saw_packets, window, window_packets, cred, cred_packets);
+	}
+
+	return 0;
+}
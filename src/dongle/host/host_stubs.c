@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "host_stubs.h"
+
+rf_rx_packet_t*	stub_rx_packet = NULL;
+
+bool		stub_kbd_ep_busy = false;
+bool		stub_consumer_ep_busy = false;
+bool		stub_usb_suspended = false;
+bool		stub_idle_elapsed = false;
+
+void (*stub_on_kbd_report)(const hid_kbd_report_t* report) = NULL;
+void (*stub_on_consumer_report)(uint8_t report) = NULL;
+
+uint32_t	stub_kbd_reports = 0, stub_consumer_reports = 0;
+uint32_t	stub_ack_payloads = 0, stub_remote_wakeups = 0;
+
+uint32_t	stub_now_us = 0;
+uint32_t	stub_poll_us = 0;
+
+// the last ACK payload the core has queued, until it goes out
+static uint8_t	ack_payload[MAX_ACK_PAYLOAD];
+static uint8_t	ack_bytes = 0;
+
+rf_rx_packet_t* rf_dngl_recv(void)
+{
+	return stub_rx_packet;
+}
+
+void rf_dngl_release(void)
+{
+	stub_rx_packet = NULL;
+}
+
+void rf_dngl_queue_ack_payload(void* buff, uint8_t num_bytes, uint8_t pipe)
+{
+	++stub_ack_payloads;
+
+	if (num_bytes <= MAX_ACK_PAYLOAD)
+	{
+		memcpy(ack_payload, buff, num_bytes);
+		ack_bytes = num_bytes;
+	}
+}
+
+void rf_dngl_suspend(bool can_wake_host)
+{
+}
+
+void rf_dngl_resume(void)
+{
+}
+
+void stub_recv(uint8_t pipe, const uint8_t* payload, uint8_t bytes)
+{
+	static rf_rx_packet_t packet;
+
+	packet.bytes = bytes;
+	packet.pipe = pipe;
+	memset(packet.payload, 0, sizeof packet.payload);
+	memcpy(packet.payload, payload, bytes);
+
+	stub_rx_packet = &packet;
+	while (stub_rx_packet)
+		dongle_poll();
+}
+
+void stub_wait(uint32_t us)
+{
+	const uint32_t until = stub_now_us + us;
+
+	while (stub_poll_us  &&  (stub_now_us / stub_poll_us + 1) * stub_poll_us <= until)
+	{
+		stub_now_us = (stub_now_us / stub_poll_us + 1) * stub_poll_us;
+
+		// the host takes the report, and the core can send the next one
+		stub_kbd_ep_busy = false;
+		dongle_poll();
+	}
+
+	stub_now_us = until;
+}
+
+uint8_t stub_send(uint8_t pipe, const uint8_t* payload, uint8_t bytes, uint8_t* ack)
+{
+	const uint8_t ret_val = ack_bytes;
+
+	stub_wait(STUB_AIR_US(bytes, ack_bytes));
+
+	memcpy(ack, ack_payload, ack_bytes);
+	ack_bytes = 0;
+
+	stub_recv(pipe, payload, bytes);
+
+	return ret_val;
+}
+
+bool usb_kbd_ep_ready(void)
+{
+	return !stub_kbd_ep_busy;
+}
+
+void usb_kbd_ep_send(const hid_kbd_report_t* report)
+{
+	++stub_kbd_reports;
+	if (stub_poll_us)
+		stub_kbd_ep_busy = true;
+
+	if (stub_on_kbd_report)
+		stub_on_kbd_report(report);
+}
+
+bool usb_consumer_ep_ready(void)
+{
+	return !stub_consumer_ep_busy;
+}
+
+void usb_consumer_ep_send(uint8_t report)
+{
+	++stub_consumer_reports;
+	if (stub_on_consumer_report)
+		stub_on_consumer_report(report);
+}
+
+bool usb_idle_elapsed(uint8_t iface)
+{
+	return stub_idle_elapsed;
+}
+
+bool usb_is_suspended(void)
+{
+	return stub_usb_suspended;
+}
+
+void usb_remote_wakeup(void)
+{
+	++stub_remote_wakeups;
+}
+
+bool usb_can_wake_host(void)
+{
+	return true;
+}
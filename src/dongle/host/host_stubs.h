@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dongle_core.h"
+#include "rf_dngl.h"
+
+// The RF and USB drivers as dongle_core.c sees them, for the native (HOST_BUILD)
+// programs in this directory. A program hands the core one packet at a time and
+// gets the reports the core sends on the endpoints.
+
+// the packet rf_dngl_recv() returns until rf_dngl_release(), NULL for none
+extern rf_rx_packet_t*	stub_rx_packet;
+
+// the endpoints are ready and the host is awake unless the program says otherwise
+extern bool		stub_kbd_ep_busy;
+extern bool		stub_consumer_ep_busy;
+extern bool		stub_usb_suspended;
+extern bool		stub_idle_elapsed;
+
+// called for every report the core sends, if set
+extern void (*stub_on_kbd_report)(const hid_kbd_report_t* report);
+extern void (*stub_on_consumer_report)(uint8_t report);
+
+extern uint32_t	stub_kbd_reports, stub_consumer_reports;
+extern uint32_t	stub_ack_payloads, stub_remote_wakeups;
+
+// queues a packet for dongle_poll() and polls until it has been processed
+void stub_recv(uint8_t pipe, const uint8_t* payload, uint8_t bytes);
+
+// The time model of the throughput tests. With stub_poll_us set, the host takes the
+// keyboard report every stub_poll_us, and the endpoint is busy from the report the
+// core sends until the next poll. Zero (the default) leaves the time out of it.
+extern uint32_t	stub_now_us;
+extern uint32_t	stub_poll_us;
+
+// the air time of a packet and its ACK at 2Mbps: two 130us PLL settlings, and the
+// preamble, address, control field and CRC (9 bytes) around each payload
+#define STUB_AIR_US(bytes, ack_bytes)	(2 * 130 + (9 + (bytes)) * 4 + (9 + (ack_bytes)) * 4)
+
+// lets the time pass with the host polls that fall into it
+void stub_wait(uint32_t us);
+
+// Sends the packet the way the keyboard does: the air time passes, the ACK brings the
+// payload the core has queued before this packet, and then the core gets the packet.
+// Copies the ACK payload into ack (MAX_ACK_PAYLOAD bytes), returns its size.
+uint8_t stub_send(uint8_t pipe, const uint8_t* payload, uint8_t bytes, uint8_t* ack);
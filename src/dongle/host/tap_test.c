@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_stubs.h"
+#include "keycode.h"
+#include "rf_protocol.h"
+#include "text_message.h"
+
+// Replays random taps of a few keys, modifiers and consumer keys as MT_KEY_EVENTS
+// messages, some with a press and a release of the same key, while the host polls the
+// endpoints irregularly. Every press and release has to get to the host: the edges it
+// sees in the reports have to add up to the events the keyboard sent. Now and then
+// the dongle types some digits in the middle of it.
+
+#define TAP_MESSAGES	200000
+
+// the events in the order of their codes
+static const uint8_t tap_codes[] =
+{
+	KC_A, KC_S, KC_D, KC_F, KC_SPACE,
+	KEY_EVENT_MOD_FIRST + 1,				// LSHIFT
+	KEY_EVENT_MOD_FIRST + 4,				// RCTRL
+	KEY_EVENT_CONS_FIRST + FN_VOL_UP_BIT,
+	KEY_EVENT_CONS_FIRST + FN_MUTE_BIT,
+};
+
+#define NUM_CODES	(sizeof tap_codes / sizeof tap_codes[0])
+
+static bool key_down[NUM_CODES];
+static uint32_t sent_edges[NUM_CODES][2], seen_edges[NUM_CODES][2];
+
+static hid_kbd_report_t prev_kbd_report;
+static uint8_t prev_consumer_report;
+
+static bool is_key_in(const uint8_t* keys, uint8_t keycode)
+{
+	uint8_t c;
+	for (c = 0; c < MAX_KEYS; c++)
+		if (keys[c] == keycode)
+			return true;
+
+	return false;
+}
+
+static void on_kbd_report(const hid_kbd_report_t* report)
+{
+	uint8_t c, code, bit;
+	bool was_down, is_down;
+
+	for (c = 0; c < NUM_CODES; c++)
+	{
+		code = tap_codes[c];
+		if (code >= KEY_EVENT_CONS_FIRST)
+			continue;
+
+		if (code >= KEY_EVENT_MOD_FIRST)
+		{
+			bit = _BV(code - KEY_EVENT_MOD_FIRST);
+			was_down = prev_kbd_report.modifiers & bit;
+			is_down = report->modifiers & bit;
+		} else {
+			was_down = is_key_in(prev_kbd_report.keys, code);
+			is_down = is_key_in(report->keys, code);
+		}
+
+		if (was_down != is_down)
+			++seen_edges[c][is_down];
+	}
+
+	prev_kbd_report = *report;
+}
+
+static void on_consumer_report(uint8_t report)
+{
+	uint8_t c, bit;
+
+	for (c = 0; c < NUM_CODES; c++)
+	{
+		if (tap_codes[c] < KEY_EVENT_CONS_FIRST)
+			continue;
+
+		bit = _BV(tap_codes[c] - KEY_EVENT_CONS_FIRST);
+		if ((prev_consumer_report ^ report) & bit)
+			++seen_edges[c][(report & bit) != 0];
+	}
+
+	prev_consumer_report = report;
+}
+
+// polls with the endpoints busy now and then, but never long enough to fill the queues
+static void host_polls(void)
+{
+	uint8_t polls = rand() % 4;
+
+	while (polls--)
+	{
+		stub_kbd_ep_busy = rand() & 1;
+		stub_consumer_ep_busy = rand() & 1;
+		dongle_poll();
+	}
+
+	stub_kbd_ep_busy = stub_consumer_ep_busy = false;
+	while (is_keyboard_report_queued()  ||  is_consumer_report_queued())
+		dongle_poll();
+}
+
+int main(void)
+{
+	rf_msg_key_events_t msg;
+	uint8_t seq = 0, num_events, c, ndx = 0;
+	uint32_t cnt, lost = 0;
+
+	stub_on_kbd_report = on_kbd_report;
+	stub_on_consumer_report = on_consumer_report;
+
+	srand(1);
+
+	msg.msg_type = MT_KEY_EVENTS;
+
+	for (cnt = 0; cnt < TAP_MESSAGES; cnt++)
+	{
+		num_events = 1 + rand() % MAX_KEY_EVENTS;
+		for (c = 0; c < num_events; c++)
+		{
+			// often the same key again, so it's tapped inside one message
+			if (c == 0  ||  (rand() & 1))
+				ndx = rand() % NUM_CODES;
+
+			key_down[ndx] = !key_down[ndx];
+			++sent_edges[ndx][key_down[ndx]];
+			msg.events[c] = tap_codes[ndx] | (key_down[ndx] ? KEY_EVENT_PRESSED : 0);
+		}
+
+		// the digits have no modifiers and none of the keys above
+		if ((cnt & 7) == 0  &&  msg_empty())
+		{
+			for (c = '0'; c <= '9'; c++)
+				msg_push(c);
+
+			msg_push(0);
+		}
+
+		msg.header = KEY_EVENTS_HEADER(seq, num_events);
+		seq = (seq + num_events) & KEY_EVENTS_SEQ_MASK;
+
+		stub_recv(0, (const uint8_t*) &msg, 2 + num_events);
+		host_polls();
+	}
+
+	for (c = 0; c < NUM_CODES; c++)
+	{
+		if (seen_edges[c][0] != sent_edges[c][0]  ||  seen_edges[c][1] != sent_edges[c][1])
+		{
+			printf("tap_test: code 0x%02x sent %u/%u presses/releases, the host got %u/%u\n", tap_codes[c],
+						sent_edges[c][1], sent_edges[c][0], seen_edges[c][1], seen_edges[c][0]);
+			++lost;
+		}
+	}
+
+	if (lost  ||  report_queue_overflows)
+	{
+		printf("tap_test: %u codes lost edges, %u queue overflows\n", lost, report_queue_overflows);
+		return 1;
+	}
+
+	printf("tap_test: %u messages, %u keyboard and %u consumer reports\n", TAP_MESSAGES, stub_kbd_reports, stub_consumer_reports);
+
+	return 0;
+}
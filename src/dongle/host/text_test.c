@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_stubs.h"
+#include "text_message.h"
+#include "text_templates.h"
+#include "text_pack.h"
+#include "rf_protocol.h"
+
+// Sends a text in MT_TEXT messages, turns the keyboard reports the dongle types it
+// with back into chars like a host would, and checks that the same text comes out.
+// With TYPING_MODIFIERS_ALONE it also checks that no report changes the modifiers
+// while a key is down in it or in the report before.
+// The text is typed for a host that polls the keyboard endpoint every 1 and 10ms
+// (see the time model in host_stubs.h). Prints the reports and the chars/s.
+// Then the tokens: every template, the packed numbers of every size at the end of
+// a message and across the wrap of the ring buffer, a number cut short by the end
+// of its message, and a menu text with tokens through the keyboard's text_pack()
+// and the dongle's unpacking.
+
+static const char test_text[] =
+	"The quick brown fox jumps over the lazy dog. THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG! "
+	"0123456789 aa bbb cccc ,./;'[]\\-= <>?:\"{}|_+ ~!@#$%^&*() Mississippi, bookkeeper. ";
+
+static char typed[1024];
+static uint16_t typed_len;
+
+static hid_kbd_report_t prev_report;
+
+// the reports that changed the modifiers with keys down
+static uint32_t modifier_changes_with_keys;
+
+// the char for each keycode and modifiers combination
+static char keycode2char[256][256];
+
+static bool is_key_in(const uint8_t* keys, uint8_t keycode)
+{
+	uint8_t c;
+	for (c = 0; c < TYPING_MAX_KEYS; c++)
+		if (keys[c] == keycode)
+			return true;
+
+	return false;
+}
+
+// the keys that weren't down in the last report have been typed, in the order of the report
+static void on_kbd_report(const hid_kbd_report_t* report)
+{
+	uint8_t c;
+	for (c = 0; c < TYPING_MAX_KEYS; c++)
+	{
+		if (report->keys[c]  &&  !is_key_in(prev_report.keys, report->keys[c])
+				&&  typed_len < sizeof typed)
+			typed[typed_len++] = keycode2char[report->modifiers][report->keys[c]];
+	}
+
+	if (report->modifiers != prev_report.modifiers  &&  (report->keys[0] != 0  ||  prev_report.keys[0] != 0))
+		++modifier_changes_with_keys;
+
+	prev_report = *report;
+}
+
+// the keyboard's text byte counter
+static uint8_t text_counter = 0;
+
+// lets the time pass until the dongle has typed the text, or gives up after 10s
+static void wait_until(bool (*is_done)(void))
+{
+	const uint32_t started = stub_now_us;
+
+	while (!is_done())
+	{
+		if (stub_now_us - started > 10000000)
+		{
+			printf("text_test: the dongle is still typing after 10s\n");
+			exit(1);
+		}
+
+		stub_wait(stub_poll_us);
+	}
+}
+
+static bool are_reports_taken(void)
+{
+	return !stub_kbd_ep_busy  &&  !is_keyboard_report_queued();
+}
+
+// sends one text message of either type and waits until the dongle has typed it
+static void send_msg(uint8_t msg_type, const void* text, uint8_t bytes, uint8_t ring_bytes)
+{
+	rf_msg_text_t msg;
+	uint8_t ack[MAX_ACK_PAYLOAD];
+
+	msg.msg_type = msg_type;
+	msg.msg_id = text_counter;
+	memcpy(msg.text, text, bytes);
+	stub_send(0, (const uint8_t*) &msg, bytes + 2, ack);
+
+	text_counter += ring_bytes + 1;
+
+	// the keyboard waits for its credits
+	wait_until(msg_empty);
+}
+
+static void send_text(const char* text, uint16_t len)
+{
+	rf_msg_text_t msg;
+	uint8_t ack[MAX_ACK_PAYLOAD];
+	uint8_t chunk;
+
+	// the probe sets the dongle's counter for the pipe
+	msg.msg_type = MT_TEXT;
+	msg.msg_id = text_counter;
+	stub_send(0, (const uint8_t*) &msg, 2, ack);
+
+	while (len)
+	{
+		chunk = len < MAX_TEXT_LEN ? len : MAX_TEXT_LEN;
+		send_msg(MT_TEXT, text, chunk, chunk);
+
+		text += chunk;
+		len -= chunk;
+	}
+
+	// the host takes the last reports, the last one releases the keys
+	wait_until(are_reports_taken);
+}
+
+// checks the text typed since the last check
+static bool is_typed(const char* what, const char* expected, uint16_t len)
+{
+	bool ret_val;
+
+	// the host takes the last reports, the last one releases the keys
+	wait_until(are_reports_taken);
+
+	ret_val = typed_len == len  &&  memcmp(typed, expected, len) == 0;
+
+	if (!ret_val)
+		printf("text_test: %s typed \"%.*s\", not \"%.*s\"\n", what, typed_len, typed, len, expected);
+
+	typed_len = 0;
+
+	return ret_val;
+}
+
+// makes a packed number token; returns its size
+static uint8_t number_token(char* buff, uint32_t num)
+{
+	uint8_t cnt = 0;
+
+	do {
+		buff[1 + cnt++] = 0x80 | (num & 0x7f);
+		num >>= 7;
+	} while (num);
+
+	buff[0] = TT_NUMBER_FIRST + cnt - 1;
+
+	return 1 + cnt;
+}
+
+// expands the tokens of the text the way the dongle types it; returns the length
+static uint16_t expand_tokens(const char* text, uint16_t len, char* out)
+{
+	uint16_t ndx = 0, out_len = 0;
+	uint32_t num;
+	uint8_t cnt, shift;
+
+	while (ndx < len)
+	{
+		const uint8_t c = text[ndx++];
+
+		if (IS_TT_NUMBER(c))
+		{
+			num = shift = 0;
+			for (cnt = TT_NUMBER_BYTES(c); cnt; --cnt, shift += 7)
+				num |= (uint32_t)(text[ndx++] & 0x7f) << shift;
+
+			out_len += sprintf(out + out_len, "%u", num);
+		} else if (IS_TT_TEMPLATE(c)) {
+			strcpy(out + out_len, text_templates[c - TT_FIRST]);
+			out_len += strlen(text_templates[c - TT_FIRST]);
+		} else {
+			out[out_len++] = c;
+		}
+	}
+
+	return out_len;
+}
+
+static bool test_templates(void)
+{
+	char text[3], expected[256];
+	uint8_t t;
+	uint16_t len;
+
+	for (t = 0; t < TT_COUNT; t++)
+	{
+		text[0] = '<';
+		text[1] = TT_FIRST + t;
+		text[2] = '>';
+		send_msg(MT_TEXT, text, sizeof text, sizeof text);
+
+		len = expand_tokens(text, sizeof text, expected);
+		if (!is_typed("a template", expected, len))
+			return false;
+	}
+
+	return true;
+}
+
+// the biggest number of every token size, and the smallest of the next one
+static const uint32_t test_numbers[] =
+{
+	0, 7, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, 0xffffffff,
+};
+
+#define NUM_TEST_NUMBERS	(sizeof test_numbers / sizeof test_numbers[0])
+
+static bool test_numbers_at_end(void)
+{
+	char text[MAX_TEXT_LEN], expected[64];
+	uint8_t n, fill, len, c;
+
+	// every fill puts the token at another place in the ring buffer
+	for (n = 0; n < NUM_TEST_NUMBERS; n++)
+	{
+		for (fill = 0; fill + TT_NUMBER_MAX_BYTES + 1 <= MAX_TEXT_LEN; fill++)
+		{
+			for (c = 0; c < fill; c++)
+				text[c] = 'a' + c;
+
+			len = fill + number_token(text + fill, test_numbers[n]);
+			send_msg(MT_TEXT, text, len, len);
+
+			if (!is_typed("a number", expected, expand_tokens(text, len, expected)))
+				return false;
+		}
+	}
+
+	// a number cut short by the end of its message is dropped
+	len = 2 + number_token(strcpy(text, "ab") + 2, test_numbers[NUM_TEST_NUMBERS - 1]);
+	send_msg(MT_TEXT, text, len - 2, len - 2);
+	send_msg(MT_TEXT, "cd", 2, 2);
+
+	return is_typed("a cut number", "abcd", 4);
+}
+
+static bool test_packed(uint16_t* chars)
+{
+	char text[600], expected[1024];
+	uint8_t packed[MAX_TEXT_LEN];
+	uint16_t len = 0, ndx = 0;
+	uint8_t packed_len, packed_bytes, ring_bytes, n;
+
+	// the menu with a bit of everything the encoding has
+	len += sprintf(text + len, TT_MENU_HEADER "Mar 3 2026" TT_BATTERY);
+	len += number_token(text + len, 2987);
+	len += sprintf(text + len, "mV" TT_RF_STATS);
+	for (n = 0; n < NUM_TEST_NUMBERS; n++)
+	{
+		len += number_token(text + len, test_numbers[n]);
+		text[len++] = '/';
+	}
+	len += sprintf(text + len, TT_MENU_POWER "-6dBm" TT_MENU_BRIGHTNESS "7" TT_MENU_OTHER "0x5A" TT_MENU_ESC);
+	len += sprintf(text + len, "Press the key for the menu - power is 100%% \"on\" #1 @ RF Esc; [OK] {ok} <~> ");
+	len += sprintf(text + len, "THE END" TT_SECONDS);
+
+	while (ndx < len)
+	{
+		packed_len = text_pack(text + ndx, len - ndx < 255 ? len - ndx : 255, packed, &packed_bytes, &ring_bytes);
+		if (packed_len == 0)
+		{
+			printf("text_test: text_pack() is stuck at %u\n", ndx);
+			return false;
+		}
+
+		send_msg(MT_TEXT_PACKED, packed, packed_bytes, ring_bytes);
+		ndx += packed_len;
+	}
+
+	*chars = expand_tokens(text, len, expected);
+
+	return is_typed("the packed text", expected, *chars);
+}
+
+int main(void)
+{
+	static const uint32_t poll_intervals[] = {1000, 10000};
+	uint32_t started, reports;
+	uint16_t len = strlen(test_text), packed_chars;
+	uint8_t p;
+	int c;
+
+	for (c = ' '; c < 0x7f; c++)
+		keycode2char[get_modifiers_for_char(c)][get_keycode_for_char(c)] = c;
+	keycode2char[get_modifiers_for_char('\n')][get_keycode_for_char('\n')] = '\n';
+
+	stub_on_kbd_report = on_kbd_report;
+
+	for (p = 0; p < sizeof poll_intervals / sizeof poll_intervals[0]; p++)
+	{
+		stub_poll_us = poll_intervals[p];
+		typed_len = 0;
+		reports = stub_kbd_reports;
+		started = stub_now_us;
+
+		send_text(test_text, len);
+
+		if (!is_typed("the text", test_text, len))
+			return 1;
+
+		if (prev_report.keys[0] != 0)
+		{
+			printf("text_test: keys still down at the end\n");
+			return 1;
+		}
+
+#ifdef TYPING_MODIFIERS_ALONE
+		if (modifier_changes_with_keys)
+		{
+			printf("text_test: %u reports changed the modifiers with keys down\n", modifier_changes_with_keys);
+			return 1;
+		}
+#endif
+
+		printf("text_test: %u chars in %u reports, host poll %2ums: %u chars/s\n", len, stub_kbd_reports - reports,
+					poll_intervals[p] / 1000, (uint32_t)((uint64_t) len * 1000000 / (stub_now_us - started)));
+	}
+
+	stub_poll_us = 1000;
+
+	if (!test_templates()  ||  !test_numbers_at_end()  ||  !test_packed(&packed_chars))
+		return 1;
+
+	printf("text_test: %u templates, %u numbers, %u chars packed and unpacked\n",
+				TT_COUNT, (uint16_t) NUM_TEST_NUMBERS, packed_chars);
+
+	return 0;
+}
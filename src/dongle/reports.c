@@ -7,6 +7,7 @@
 #include "keycode.h"
 #include "rf_protocol.h"
 #include "text_message.h"
+#include "text_templates.h"
 #include "rf_dngl.h"
 
 #include "nrfdbg.h"
@@ -31,43 +32,524 @@ void reset_keyboard_report(void)
 	usb_keyboard_report.keys[5] = KC_NO;
 }
 
+// The reports wait in these queues for the IN endpoints, so a press and a release that
+// arrive between two polls of the host both get to the host. A new report replaces the
+// last queued one only if no key or modifier changes in both; if the queue is full it
+// replaces it anyway, and that's counted as an overflow.
+#define REPORT_QUEUE_SIZE		8
+
+__xdata hid_kbd_report_t kbd_queue[REPORT_QUEUE_SIZE];
+uint8_t kbd_queue_head, kbd_queue_count;
+__xdata hid_kbd_report_t kbd_report_sent;		// the last report we gave the endpoint
+
+__xdata uint8_t consumer_queue[REPORT_QUEUE_SIZE];
+uint8_t consumer_queue_head, consumer_queue_count;
+uint8_t consumer_report_sent;
+
+uint16_t report_queue_overflows;
+
+static void copy_kbd_report(__xdata hid_kbd_report_t* dest, const hid_kbd_report_t* src)
+{
+	uint8_t key_cnt;
+
+	dest->modifiers = src->modifiers;
+	dest->unused = 0;
+	for (key_cnt = 0; key_cnt < sizeof dest->keys; key_cnt++)
+		dest->keys[key_cnt] = src->keys[key_cnt];
+}
+
+static bool has_key(const uint8_t* keys, const uint8_t keycode)
+{
+	uint8_t key_cnt;
+
+	for (key_cnt = 0; key_cnt < sizeof usb_keyboard_report.keys; key_cnt++)
+	{
+		if (keys[key_cnt] == keycode)
+			return true;
+	}
+
+	return false;
+}
+
+// true if dropping mid from the prev, mid, next sequence of reports loses no press or release
+static bool can_merge_kbd_report(const hid_kbd_report_t* prev, const hid_kbd_report_t* mid, const hid_kbd_report_t* next)
+{
+	uint8_t key_cnt, keycode;
+
+	if ((prev->modifiers ^ mid->modifiers) & (mid->modifiers ^ next->modifiers))
+		return false;
+
+	for (key_cnt = 0; key_cnt < sizeof mid->keys; key_cnt++)
+	{
+		// pressed in mid and released in next
+		keycode = mid->keys[key_cnt];
+		if (keycode != KC_NO  &&  !has_key(prev->keys, keycode)  &&  !has_key(next->keys, keycode))
+			return false;
+
+		// released in mid and pressed again in next
+		keycode = prev->keys[key_cnt];
+		if (keycode != KC_NO  &&  !has_key(mid->keys, keycode)  &&  has_key(next->keys, keycode))
+			return false;
+	}
+
+	return true;
+}
+
+void push_keyboard_report(const hid_kbd_report_t* report)
+{
+	__xdata hid_kbd_report_t* last;
+	__xdata hid_kbd_report_t* prev;
+
+	if (kbd_queue_count)
+	{
+		last = &kbd_queue[(kbd_queue_head + kbd_queue_count - 1) % REPORT_QUEUE_SIZE];
+		prev = kbd_queue_count > 1
+					? &kbd_queue[(kbd_queue_head + kbd_queue_count - 2) % REPORT_QUEUE_SIZE]
+					: &kbd_report_sent;
+
+		if (can_merge_kbd_report(prev, last, report)  ||  kbd_queue_count == REPORT_QUEUE_SIZE)
+		{
+			if (kbd_queue_count == REPORT_QUEUE_SIZE)
+				++report_queue_overflows;
+
+			copy_kbd_report(last, report);
+			return;
+		}
+	}
+
+	copy_kbd_report(&kbd_queue[(kbd_queue_head + kbd_queue_count) % REPORT_QUEUE_SIZE], report);
+	++kbd_queue_count;
+}
+
+void collapse_report_queues(void)
+{
+	if (kbd_queue_count > 1)
+	{
+		kbd_queue_head = (kbd_queue_head + kbd_queue_count - 1) % REPORT_QUEUE_SIZE;
+		kbd_queue_count = 1;
+	}
+
+	if (consumer_queue_count > 1)
+	{
+		consumer_queue_head = (consumer_queue_head + consumer_queue_count - 1) % REPORT_QUEUE_SIZE;
+		consumer_queue_count = 1;
+	}
+}
+
+bool is_keyboard_report_queued(void)
+{
+	return kbd_queue_count != 0;
+}
+
+__xdata const hid_kbd_report_t* pop_keyboard_report(void)
+{
+	if (kbd_queue_count)
+	{
+		copy_kbd_report(&kbd_report_sent, &kbd_queue[kbd_queue_head]);
+		kbd_queue_head = (kbd_queue_head + 1) % REPORT_QUEUE_SIZE;
+		--kbd_queue_count;
+	}
+
+	return &kbd_report_sent;
+}
+
+void push_consumer_report(void)
+{
+	__xdata uint8_t* last;
+	uint8_t prev;
+
+	if (consumer_queue_count)
+	{
+		last = &consumer_queue[(consumer_queue_head + consumer_queue_count - 1) % REPORT_QUEUE_SIZE];
+		prev = consumer_queue_count > 1
+					? consumer_queue[(consumer_queue_head + consumer_queue_count - 2) % REPORT_QUEUE_SIZE]
+					: consumer_report_sent;
+
+		if (((prev ^ *last) & (*last ^ usb_consumer_report)) == 0  ||  consumer_queue_count == REPORT_QUEUE_SIZE)
+		{
+			if (consumer_queue_count == REPORT_QUEUE_SIZE)
+				++report_queue_overflows;
+
+			*last = usb_consumer_report;
+			return;
+		}
+	}
+
+	consumer_queue[(consumer_queue_head + consumer_queue_count) % REPORT_QUEUE_SIZE] = usb_consumer_report;
+	++consumer_queue_count;
+}
+
+bool is_consumer_report_queued(void)
+{
+	return consumer_queue_count != 0;
+}
+
+uint8_t pop_consumer_report(void)
+{
+	if (consumer_queue_count)
+	{
+		consumer_report_sent = consumer_queue[consumer_queue_head];
+		consumer_queue_head = (consumer_queue_head + 1) % REPORT_QUEUE_SIZE;
+		--consumer_queue_count;
+	}
+
+	return consumer_report_sent;
+}
+
+// The keyboard reports come from two sources: the live key state of the keyboards
+// (usb_keyboard_report) and the text we type (text_report). arbitrate_reports() switches
+// between them only when the host has seen all the keys and modifiers of the previous
+// source go up, so the modifiers of one never apply to the keys of the other.
+//
+// By default the text pauses while a key is held: a key press in the middle of the text
+// releases the text keys, and the text continues when all the keys are up again.
+// Define this to hold the key state back until the text is typed out instead.
+//#define TEXT_HOLDS_KEYS
+
+hid_kbd_report_t text_report;
+bool live_pending;			// usb_keyboard_report has changed since we queued it
+bool live_sent_up = true;	// the last queued live report has all the keys up
+
+// the reports queued from each source, and the reports the other source queued
+// while one had a report waiting
+uint16_t live_reports, text_reports;
+uint16_t live_wait_reports, text_wait_reports;
+
+bool is_key_state_changed(void)
+{
+	return live_pending;
+}
+
+static bool is_report_up(const hid_kbd_report_t* report)
+{
+	// the keys are packed to the front of the array
+	return report->modifiers == 0  &&  report->keys[0] == KC_NO;
+}
+
+static bool is_text_turn(void)
+{
+	// the host has text keys down, we have to release them first
+	if (!is_report_up(&text_report))
+		return true;
+
+	if (msg_empty()  ||  !live_sent_up)
+		return false;
+
+#ifdef TEXT_HOLDS_KEYS
+	return true;
+#else
+	return !live_pending;
+#endif
+}
+
+static void push_text_report(void)
+{
+	push_keyboard_report(&text_report);
+	++text_reports;
+
+	if (live_pending)
+		++live_wait_reports;
+}
+
+void arbitrate_reports(void)
+{
+	uint8_t key_cnt;
+	bool release;
+
+	if (is_text_turn())
+	{
+#ifdef TEXT_HOLDS_KEYS
+		release = false;
+#else
+		release = live_pending;		// a key was pressed in the middle of the text
+#endif
+
+		// one text report per poll, but a key releases the text keys right away
+		if (is_keyboard_report_queued()  &&  !release)
+			return;
+
+		// release the text keys if we're out of text too
+		if (release  ||  !msg_type_report(&text_report.modifiers, text_report.keys))
+		{
+			text_report.modifiers = 0;
+			for (key_cnt = 0; key_cnt < sizeof text_report.keys; key_cnt++)
+				text_report.keys[key_cnt] = KC_NO;
+
+			msg_type_release();
+		}
+
+		push_text_report();
+
+	} else if (live_pending) {
+
+		push_keyboard_report(&usb_keyboard_report);
+		live_pending = false;
+		live_sent_up = is_report_up(&usb_keyboard_report);
+		++live_reports;
+
+		if (!msg_empty())
+			++text_wait_reports;
+	}
+}
+
+// The key state of every keyboard (one per pipe). The USB reports are the union of all
+// the keyboards: their modifiers and consumer bits ORed, and their keys without duplicates.
+typedef struct
+{
+	uint8_t		modifiers;
+	uint8_t		consumer;
+	uint8_t		keys[MAX_KEYS];
+
+	uint8_t		next_event_seq;			// the sequence number of the next key event we expect
+	bool		is_event_seq_valid;
+} pipe_key_state_t;
+
+__xdata pipe_key_state_t pipe_key_state[RF_NUM_PIPES];
+
+static void press_key(__xdata uint8_t* keys, const uint8_t keycode)
+{
+	uint8_t key_cnt;
+
+	for (key_cnt = 0; key_cnt < MAX_KEYS; key_cnt++)
+	{
+		if (keys[key_cnt] == keycode)
+			return;		// already pressed
+
+		if (keys[key_cnt] == KC_NO)
+		{
+			keys[key_cnt] = keycode;
+			return;
+		}
+	}
+}
+
+static void release_key(__xdata uint8_t* keys, const uint8_t keycode)
+{
+	uint8_t key_cnt;
+	bool found = false;
+
+	// remove the key and move the ones after it down
+	for (key_cnt = 0; key_cnt < MAX_KEYS; key_cnt++)
+	{
+		if (keys[key_cnt] == keycode)
+			found = true;
+
+		if (found)
+			keys[key_cnt] = key_cnt < MAX_KEYS - 1 ? keys[key_cnt + 1] : KC_NO;
+	}
+}
+
+// Queues the key state that waits for arbitrate_reports() before the next change replaces
+// it, so none of its presses and releases is lost. The first round may only release the
+// text keys. With TEXT_HOLDS_KEYS the key state waits for the text, and only its last
+// state gets to the host.
+static void flush_key_state(void)
+{
+#ifndef TEXT_HOLDS_KEYS
+	if (live_pending)
+		arbitrate_reports();
+
+	if (live_pending)
+		arbitrate_reports();
+#endif
+}
+
+// Builds usb_keyboard_report and usb_consumer_report from the key state of all the
+// keyboards. The consumer report is queued, the keyboard report waits for
+// arbitrate_reports(). That's at most RF_NUM_PIPES * MAX_KEYS keys, so the time is bounded.
+static void merge_key_state(void)
+{
+	__xdata pipe_key_state_t* state;
+	uint8_t pipe, key_cnt;
+
+	reset_keyboard_report();
+	usb_consumer_report = 0;
+
+	for (pipe = 0; pipe < RF_NUM_PIPES; pipe++)
+	{
+		state = &pipe_key_state[pipe];
+
+		usb_keyboard_report.modifiers |= state->modifiers;
+		usb_consumer_report |= state->consumer;
+
+		for (key_cnt = 0; key_cnt < MAX_KEYS  &&  state->keys[key_cnt] != KC_NO; key_cnt++)
+			press_key(usb_keyboard_report.keys, state->keys[key_cnt]);
+	}
+
+	live_pending = true;
+
+	push_consumer_report();
+}
+
 // updates usb_keyboard_report and usb_consumer_report from the
 // data in the key state message contained in the recv_buffer
-void process_key_state_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received)
+void process_key_state_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe)
 {
 	__xdata const rf_msg_key_state_report_t* key_state_msg = (const rf_msg_key_state_report_t*) recv_buffer;
+	__xdata pipe_key_state_t* state = &pipe_key_state[pipe];
 	__xdata uint8_t key_cnt;
 
-	usb_consumer_report = key_state_msg->consumer;				// the consumer report
-	
-	reset_keyboard_report();
-	
-	usb_keyboard_report.modifiers = key_state_msg->modifiers;	// set the modifiers
+	flush_key_state();
+
+	// the keyboard starts a new event sequence after a full state report
+	state->is_event_seq_valid = false;
+
+	state->consumer = key_state_msg->consumer;		// the consumer report
+	state->modifiers = key_state_msg->modifiers;	// set the modifiers
 
 	// copy the keycodes
-	for (key_cnt = 0; key_cnt < bytes_received - 3; key_cnt++)
-		usb_keyboard_report.keys[key_cnt] = key_state_msg->keys[key_cnt];
+	for (key_cnt = 0; key_cnt < MAX_KEYS; key_cnt++)
+		state->keys[key_cnt] = key_cnt < bytes_received - 3 ? key_state_msg->keys[key_cnt] : KC_NO;
+
+	merge_key_state();
 }
 
-void process_text_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received)
+// applies the press/release events in the key events message to
+// usb_keyboard_report and usb_consumer_report
+void process_key_events_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe)
+{
+	__xdata const rf_msg_key_events_t* msg = (__xdata const rf_msg_key_events_t*) recv_buffer;
+	__xdata pipe_key_state_t* state = &pipe_key_state[pipe];
+	uint8_t seq = KEY_EVENTS_SEQ(msg->header);
+	uint8_t num_events = KEY_EVENTS_CNT(msg->header);
+	uint8_t ev_cnt, chg_cnt;
+
+	// the codes the events have changed since the key state was last merged
+	__xdata uint8_t changed[MAX_KEY_EVENTS];
+	uint8_t num_changed = 0;
+
+	if (num_events > bytes_received - 2)
+		return;
+
+	flush_key_state();
+
+	for (ev_cnt = 0; ev_cnt < num_events; ev_cnt++)
+	{
+		uint8_t event = msg->events[ev_cnt];
+		uint8_t code = event & KEY_EVENT_CODE_MASK;
+		uint8_t mask;
+
+		// skip the events we have already applied from a resent message
+		// (the sequence numbers in the lower half of the window behind the expected one)
+		if (state->is_event_seq_valid  &&  ((seq - state->next_event_seq) & KEY_EVENTS_SEQ_MASK) > KEY_EVENTS_SEQ_MASK / 2)
+		{
+			seq = (seq + 1) & KEY_EVENTS_SEQ_MASK;
+			continue;
+		}
+
+		// We might have missed some events if the sequence has a gap, but there is not much
+		// we can do about that. The next full state report from the keyboard will fix it.
+		seq = (seq + 1) & KEY_EVENTS_SEQ_MASK;
+		state->next_event_seq = seq;
+		state->is_event_seq_valid = true;
+
+		// a key tapped within the message: queue its press before the release undoes it
+		for (chg_cnt = 0; chg_cnt < num_changed  &&  changed[chg_cnt] != code; chg_cnt++)
+			;
+
+		if (chg_cnt < num_changed)
+		{
+			merge_key_state();
+			flush_key_state();
+			num_changed = 0;
+		}
+
+		changed[num_changed++] = code;
+
+		if (code >= KEY_EVENT_CONS_FIRST)
+		{
+			mask = _BV(code - KEY_EVENT_CONS_FIRST);
+			if (event & KEY_EVENT_PRESSED)
+				state->consumer |= mask;
+			else
+				state->consumer &= ~mask;
+		} else if (code >= KEY_EVENT_MOD_FIRST) {
+			mask = _BV(code - KEY_EVENT_MOD_FIRST);
+			if (event & KEY_EVENT_PRESSED)
+				state->modifiers |= mask;
+			else
+				state->modifiers &= ~mask;
+		} else if (event & KEY_EVENT_PRESSED) {
+			press_key(state->keys, code);
+		} else {
+			release_key(state->keys, code);
+		}
+	}
+
+	merge_key_state();
+}
+
+// Define this to measure the time it takes to unpack MT_TEXT_PACKED messages with Timer0.
+// Needs DBG_MODE for the output, and works only on the nRF24LU1.
+//#define MEASURE_UNPACK
+
+#if defined(MEASURE_UNPACK)  &&  defined(NRF24LU1)
+# include "reg24lu1.h"
+#endif
+
+// The keyboards share the text buffer. The credits of each one are at most
+// TEXT_PIPE_CREDITS (a packed message can take MAX_TEXT_LEN * 2 + 1 bytes of the
+// buffer), and the text the others may still send is kept free for them, so
+// all the credits together never take more than the free space.
+#define TEXT_PIPE_CREDITS		(MAX_TEXT_LEN * 2 + 1)
+
+void process_text_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe)
 {
 	__xdata const rf_msg_text_t* msg = (__xdata const rf_msg_text_t*) recv_buffer;
-	const char* txt = msg->text;
-	const uint8_t txt_size = bytes_received - 2;
-	__xdata rf_msg_text_buff_state_t msg_ack;
+	__xdata const char* txt = msg->text;
+	const bool is_packed = msg->msg_type == MT_TEXT_PACKED;
+	const uint8_t txt_size = is_packed
+								? msg_unpacked_size((__xdata const uint8_t*) txt, bytes_received - 2)
+								: bytes_received - 2;
+	__xdata rf_msg_text_credits_t msg_ack;
+
+	// every keyboard has its own text byte counter; they share the text buffer
+	static __xdata uint8_t prev_msg_ids[RF_NUM_PIPES];
+	__xdata uint8_t* prev_msg_id = &prev_msg_ids[pipe];
 
-	static uint8_t prev_msg_id = 0;
+	// the keyboard's text byte counter after the messages we have stored
+	static __xdata uint8_t text_counters[RF_NUM_PIPES];
+	__xdata uint8_t* text_counter = &text_counters[pipe];
 
-	if (txt_size  &&  prev_msg_id != msg->msg_id)
+	// the credit limits we have given the keyboards; they only ever move forward
+	static __xdata uint8_t text_limits[RF_NUM_PIPES];
+	__xdata uint8_t* text_limit = &text_limits[pipe];
+
+	uint16_t reserved;
+	uint8_t grant, p;
+
+	if (txt_size == 0)
 	{
+		// a probe tells us where the keyboard's counter is; the next message
+		// will have the same id, so don't take it for a resend
+		*text_counter = msg->msg_id;
+		*prev_msg_id = msg->msg_id - 1;
+
+	} else if (*prev_msg_id != msg->msg_id) {
+
 		// also, check if we have enough space for the entire message
 		uint8_t buff_free = msg_free();
 		if (buff_free >= txt_size + 1)
 		{
 			// copy the text to our ring buffer
-			uint8_t ndx = 0;
-			while (ndx < txt_size)
-				msg_push(txt[ndx++]);
+			if (is_packed)
+			{
+#if defined(MEASURE_UNPACK)  &&  defined(NRF24LU1)
+				TMOD = (TMOD & 0xf0) | 0x01;	// Timer0 in 16 bit mode, CCLK/12
+				TH0 = TL0 = 0;
+				TR0 = 1;
+#endif
+				msg_push_packed((__xdata const uint8_t*) txt, bytes_received - 2);
+
+#if defined(MEASURE_UNPACK)  &&  defined(NRF24LU1)
+				TR0 = 0;
+				dprintf("unpacked %d chars in %u us\n", txt_size, ((TH0 << 8) | TL0) / 4 * 3);	// 0.75us per tick at 16MHz
+#endif
+			} else {
+				uint8_t ndx = 0;
+				while (ndx < txt_size)
+					msg_push(txt[ndx++]);
+			}
 
 			msg_push(0);	// adds a key-up at the end of the message
 			
@@ -78,12 +560,35 @@ void process_text_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_re
 			msg_push(0);
 		}
 
-		prev_msg_id = msg->msg_id;	// remember this message id
+		*prev_msg_id = msg->msg_id;	// remember this message id
+		*text_counter = msg->msg_id + txt_size + 1;
 	}
 
-	// queue the buffer state in the ACK
-	msg_ack.msg_type = MT_TEXT_BUFF_FREE;
-	msg_ack.bytes_free = msg_free();
-	msg_ack.bytes_capacity = msg_capacity();
-	rf_dngl_queue_ack_payload(&msg_ack, sizeof msg_ack);
+	// a keyboard never sends past its limit, unless it has started over
+	if ((uint8_t)(*text_limit - *text_counter) > TEXT_PIPE_CREDITS)
+		*text_limit = *text_counter;
+
+	// the text the other keyboards may still send is reserved
+	reserved = 0;
+	for (p = 0; p < RF_NUM_PIPES; ++p)
+	{
+		if (p != pipe)
+			reserved += (uint8_t)(text_limits[p] - text_counters[p]);
+	}
+
+	grant = msg_free();
+	grant = grant > reserved ? grant - reserved : 0;
+	if (grant > TEXT_PIPE_CREDITS)
+		grant = TEXT_PIPE_CREDITS;
+
+	if ((int8_t)(*text_counter + grant - *text_limit) > 0)
+		*text_limit = *text_counter + grant;
+
+	// queue the credits in the ACK
+	msg_ack.msg_type = MT_TEXT_CREDITS;
+	msg_ack.credit_limit = *text_limit;
+	msg_ack.capacity = msg_capacity();
+	msg_ack.templates_version = TEXT_TEMPLATES_VERSION;
+	msg_ack.typed_out = msg_empty();
+	rf_dngl_queue_ack_payload(&msg_ack, sizeof msg_ack, pipe);
 }
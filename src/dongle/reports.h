@@ -1,10 +1,17 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "tgtdefs.h"
 
 void reset_keyboard_report(void);
-void process_key_state_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received);
-void process_text_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received);
+
+// the messages from the keyboard on the pipe; dongle_poll() checks their length against
+// the message type before they get here
+void process_key_state_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe);
+void process_key_events_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe);
+void process_text_msg(__xdata const uint8_t* recv_buffer, const uint8_t bytes_received, const uint8_t pipe);
 
 // this is the HID report structure
 // this is what the data that we send to the host is comprised of
@@ -33,3 +40,31 @@ extern uint8_t			usb_led_report;		// bit	LED
 											// 0	CAPS
 											// 1	NUM
 											// 2	SCROLL
+
+// The queues between the RF messages and the IN endpoints. push_consumer_report() queues
+// usb_consumer_report. The pop functions return the next report to send, or the last
+// one sent again if nothing is queued (for the HID idle rate).
+void push_keyboard_report(const hid_kbd_report_t* report);
+bool is_keyboard_report_queued(void);
+__xdata const hid_kbd_report_t* pop_keyboard_report(void);
+
+void push_consumer_report(void);
+bool is_consumer_report_queued(void);
+uint8_t pop_consumer_report(void);
+
+extern uint16_t report_queue_overflows;		// reports replaced because a queue was full
+
+// Drops all the queued reports but the last ones, so a resumed host gets the keys
+// as they are now instead of the keystrokes from before its suspend.
+void collapse_report_queues(void);
+
+// Queues the next keyboard report from the live key state or from the text.
+// Call it from the main loop after the RF messages are processed.
+void arbitrate_reports(void);
+
+// true if the key state has changed since arbitrate_reports() last queued it
+bool is_key_state_changed(void);
+
+// the reports queued from each source, and the reports the other source queued while one waited
+extern uint16_t live_reports, text_reports;
+extern uint16_t live_wait_reports, text_wait_reports;
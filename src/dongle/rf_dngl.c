@@ -1,13 +1,185 @@
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "leds.h"
 #include "rf_protocol.h"
 #include "nRF24L.h"
+#include "rf_profiles.h"
+#include "rf_dngl.h"
+
+#ifdef NRF24LU1
+# include "nrfutils.h"
+#endif
 
 #define NRF_CHECK_MODULE
 
+#ifndef NRF24LU1
+# include <avr/interrupt.h>
+#endif
+
+// the nRF IRQ: the RF interrupt on the nRF24LU1, the pin change interrupt of the IRQ pin on the AVR
+#ifdef NRF24LU1
+# define RF_IRQ_DISABLE()	RF = 0
+# define RF_IRQ_ENABLE()	RF = 1
+#else
+# define RF_IRQ_DISABLE()	PCICR &= ~_BV(PCIE2)
+# define RF_IRQ_ENABLE()	PCICR |= _BV(PCIE2)
+#endif
+
+// The RF interrupt drains the RX FIFO into this ring, so the main loop talks to
+// the nRF only when there's something to do. The ring is a power of 2 of packets,
+// and the head and tail indices run freely.
+#define RX_RING_SIZE		4
+
+__xdata rf_rx_packet_t rx_ring[RX_RING_SIZE];
+volatile uint8_t rx_ring_head;		// written by the interrupt
+volatile uint8_t rx_ring_tail;		// written by the main loop
+volatile bool rx_stalled;			// the ring was full with packets still in the RX FIFO
+
+#ifdef MEASURE_RX
+volatile uint16_t rf_rx_stamp;
+volatile bool rf_rx_stamp_valid;
+#endif
+
+// The ACK payload scheduler: the latest message of every type waits in its slot, and all
+// the pending slots of a pipe are packed into one ACK payload (see ACK_MSG_SIZE). The slots
+// are in priority order in case they don't all fit into one payload.
+// A payload goes out with the ACK of the next packet on its pipe, but the nRF doesn't tell
+// us which pipe's payload it has sent. So we keep only one payload in the TX FIFO: it has
+// been delivered when the FIFO is empty, and then we load the next one.
+// All of this runs in the main loop (rf_dngl_release() and rf_dngl_queue_ack_payload()) with
+// the RF interrupt disabled; the interrupt only moves the packets into the RX ring.
+enum
+{
+	ACK_SLOT_LED_STATUS,
+	ACK_SLOT_TEXT_CREDITS,
+	ACK_SLOT_HOST_STATE,
+
+	ACK_SLOT_COUNT
+};
+
+#define ACK_SLOT_BYTES		sizeof(rf_msg_text_credits_t)	// the biggest message in a slot
+
+// the packets from the other pipes we let through while the payload waits
+// for its keyboard, before we give the FIFO to one of them
+#define ACK_EVICT_PACKETS	2
+
+__xdata uint8_t ack_slots[RF_NUM_PIPES][ACK_SLOT_COUNT][ACK_SLOT_BYTES];
+__xdata uint8_t ack_payload[MAX_ACK_PAYLOAD];
+__xdata uint8_t ack_pending[RF_NUM_PIPES];		// bit masks of the slots waiting for an ACK payload
+uint8_t ack_loaded;				// the slots in the payload in the nRF TX FIFO
+uint8_t ack_loaded_pipe;		// and its pipe
+uint8_t ack_passed;				// the packets of the other pipes since it was loaded
+
+// the pipes we have received packets on; a payload for a pipe without a
+// keyboard would sit in the TX FIFO forever, so only these get ACK payloads
+uint8_t pipes_seen;
+
+static uint8_t ack_slot(const uint8_t msg_type)
+{
+	if (msg_type == MT_LED_STATUS)
+		return ACK_SLOT_LED_STATUS;
+
+	if (msg_type == MT_TEXT_CREDITS)
+		return ACK_SLOT_TEXT_CREDITS;
+
+	if (msg_type == MT_HOST_STATE)
+		return ACK_SLOT_HOST_STATE;
+
+	return ACK_SLOT_COUNT;
+}
+
+// packs the pending slots of the pipe into an ACK payload and loads it into the nRF
+static void rf_dngl_load_ack_payload(const uint8_t pipe)
+{
+	uint8_t bytes = 0;
+	uint8_t slot, msg_bytes;
+
+	for (slot = 0; slot < ACK_SLOT_COUNT; ++slot)
+	{
+		if ((ack_pending[pipe] & _BV(slot)) == 0)
+			continue;
+
+		msg_bytes = ACK_MSG_SIZE(ack_slots[pipe][slot][0]);
+		if (bytes + msg_bytes <= MAX_ACK_PAYLOAD)
+		{
+			memcpy_X(ack_payload + bytes, ack_slots[pipe][slot], msg_bytes);
+			bytes += msg_bytes;
+
+			ack_pending[pipe] &= ~_BV(slot);
+			ack_loaded |= _BV(slot);
+		}
+	}
+
+	if (bytes)
+	{
+		nRF_WriteAckPayload(ack_payload, bytes, pipe);
+		ack_loaded_pipe = pipe;
+		ack_passed = 0;
+	}
+}
+
+// Empties the TX FIFO and puts the slots of the flushed payload back to pending. If the
+// keyboard got its payload after all, it gets the same messages twice, which is harmless.
+static void rf_dngl_flush_ack_fifo(void)
+{
+	nRF_FlushTX();
+
+	ack_pending[ack_loaded_pipe] |= ack_loaded;
+	ack_loaded = 0;
+}
+
+// forgets the loaded payload if the keyboard has taken it
+static void rf_dngl_check_ack_sent(void)
+{
+	if (ack_loaded)
+	{
+		nRF_ReadReg(FIFO_STATUS);
+		if (nRF_data[1] & vTX_EMPTY)
+			ack_loaded = 0;
+	}
+}
+
+// loads the next payload if the FIFO is free; the pipe we have just heard from goes first
+static void rf_dngl_fill_ack_fifo(const uint8_t active_pipe)
+{
+	uint8_t pipe;
+
+	if (ack_loaded)
+		return;
+
+	if (active_pipe < RF_NUM_PIPES  &&  ack_pending[active_pipe])
+	{
+		rf_dngl_load_ack_payload(active_pipe);
+		return;
+	}
+
+	for (pipe = 0; pipe < RF_NUM_PIPES; ++pipe)
+	{
+		if (ack_pending[pipe]  &&  (pipes_seen & _BV(pipe)))
+		{
+			rf_dngl_load_ack_payload(pipe);
+			return;
+		}
+	}
+}
+
+// called for every packet the main loop has processed
+static void rf_dngl_update_ack_payloads(const uint8_t pipe)
+{
+	pipes_seen |= _BV(pipe);
+
+	rf_dngl_check_ack_sent();
+
+	// the payload waits for a keyboard that doesn't send; this one does
+	if (ack_loaded  &&  pipe != ack_loaded_pipe  &&  ack_pending[pipe]
+			&&  ++ack_passed >= ACK_EVICT_PACKETS)
+		rf_dngl_flush_ack_fifo();
+
+	rf_dngl_fill_ack_fifo(pipe);
+}
 
 void rf_dngl_init(void)
 {
@@ -43,72 +215,254 @@ void rf_dngl_init(void)
 
 #endif	// NRF_CHECK_MODULE
 
-	nRF_WriteReg(EN_AA, vENAA_P0);			// enable auto acknowledge
-	nRF_WriteReg(SETUP_RETR, vARD_250us);	// ARD=250us, ARC=disabled
-	nRF_WriteReg(RF_SETUP, vRF_DR_2MBPS		// data rate
-						| vRF_PWR_0DBM);	// output power
-
-	nRF_WriteReg(FEATURE, vEN_DPL | vEN_ACK_PAY);	// enable dynamic payload length and ACK payload
-	nRF_WriteReg(DYNPD, vDPL_P0);					// enable dynamic payload length for pipe 0
+	// pipe 1 takes the entire DongleAddr2, the others only the first byte
+	nRF_WriteAddrReg(RX_ADDR_P1, DongleAddr2, NRF_ADDR_SIZE);
+	nRF_WriteReg(RX_ADDR_P2, PIPE_ADDR_LSB(2));
+	nRF_WriteReg(RX_ADDR_P3, PIPE_ADDR_LSB(3));
+	nRF_WriteReg(RX_ADDR_P4, PIPE_ADDR_LSB(4));
+	nRF_WriteReg(RX_ADDR_P5, PIPE_ADDR_LSB(5));
 
 	nRF_FlushRX();
 	nRF_FlushTX();
 	
-	nRF_WriteReg(EN_RXADDR, vERX_P0);					// enable RX address
 	nRF_WriteReg(STATUS, vRX_DR | vTX_DS | vMAX_RT);	// reset the IRQ flags
 
-	nRF_WriteReg(RF_CH, CHANNEL_NUM);			// set the channel
-	nRF_WriteReg(CONFIG, vEN_CRC | vCRCO 		// enable a 2 byte CRC
-								| vMASK_TX_DS	// we don't care about the TX_DS status flag
-								| vPRIM_RX		// RX mode
-								| vPWR_UP);		// power up the transceiver
+	rf_apply_profile(rf_profile_dongle_rx);		// this also powers up the transceiver
 
 	nRF_CE_hi();		// start receiving
+
+	// the nRF IRQ pin drives the RX
+#ifndef NRF24LU1
+	PCMSK2 |= _BV(PCINT23);
+#endif
+	RF_IRQ_ENABLE();
 }
 
-uint8_t rf_dngl_recv(__xdata void* buff, uint8_t buff_size)
+// Drains the RX FIFO into the packet ring. Called from the RF interrupt, or with the
+// interrupt disabled when the ring was full and the main loop has made room.
+static void rf_dngl_drain_rx(void)
 {
-	uint8_t ret_val = 0;
-	
-	// check if there's data in the RX FIFO
-	nRF_ReadReg(FIFO_STATUS);
-	if ((nRF_data[1] & vRX_EMPTY) == 0)
+	__xdata rf_rx_packet_t* pkt;
+	uint8_t pipe, bytes;
+
+	LED_on();
+
+	// clear the flags first: a packet that arrives while we drain raises the IRQ again
+	nRF_WriteReg(STATUS, vRX_DR | vTX_DS);
+
+	rx_stalled = false;
+
+	for (;;)
 	{
-		LED_on();
-		
-		// read the payload
+		if ((uint8_t)(rx_ring_head - rx_ring_tail) == RX_RING_SIZE)
+		{
+			// the rest stays in the RX FIFO until rf_dngl_release() makes room
+			rx_stalled = true;
+			break;
+		}
+
+		nRF_ReadReg(FIFO_STATUS);
+		if (nRF_data[1] & vRX_EMPTY)
+			break;
+
+		// FIFO_STATUS always goes to the chip, so nRF_data[0] is a fresh STATUS
+		// with the pipe of the packet at the top of the RX FIFO
+		pipe = RX_P_NO(nRF_data[0]);
+
 		nRF_ReadRxPayloadWidth();
-		ret_val = nRF_data[1];
+		bytes = nRF_data[1];
 
 		// the nRF specs state I have to drop the packet if the length is > 32
-		if (ret_val > 32)
+		if (bytes > MAX_PAYLOAD)
 		{
 			nRF_FlushRX();
-			ret_val = 0;
-		} else {
-			nRF_ReadRxPayload(ret_val);
-			memcpy_X(buff, nRF_data + 1, ret_val > buff_size ? buff_size : ret_val);
+			break;
 		}
 
-		// reset the TX_DS
-		if (nRF_data[0] & vTX_DS)
-			nRF_WriteReg(STATUS, vTX_DS);
+		pkt = &rx_ring[rx_ring_head % RX_RING_SIZE];
+		nRF_ReadRxPayloadTo(pkt->payload, bytes);
+		pkt->bytes = bytes;
+		pkt->pipe = pipe;
+		++rx_ring_head;
+	}
+
+	LED_off();
+}
 
-		LED_off();
+#ifdef NRF24LU1
+
+void rf_dngl_isr(void) __interrupt(INTERRUPT_RFIRQ)
+{
+#ifdef MEASURE_RX
+	if (!rf_rx_stamp_valid)
+	{
+		rf_rx_stamp = (TH0 << 8) | TL0;
+		rf_rx_stamp_valid = true;
 	}
-	
-	return ret_val;
+#endif
+
+	rf_dngl_drain_rx();
+}
+
+#else
+
+// V-USB has to get into its interrupt within a few cycles, so we let it interrupt us
+// from the first instruction on. A pin change that gets in before RF_IRQ_DISABLE()
+// only drains the FIFO before we do.
+ISR(PCINT2_vect, ISR_NOBLOCK)
+{
+	if (PIN(NRF_IRQ_PORT) & _BV(NRF_IRQ_BIT))
+		return;		// the IRQ pin went high
+
+	RF_IRQ_DISABLE();	// don't nest
+
+	rf_dngl_drain_rx();
+
+	cli();
+	RF_IRQ_ENABLE();
+}
+
+#endif	// NRF24LU1
+
+// While the host is suspended Timer1 switches the receiver on for RF_SUSPEND_RX_ON_MS
+// and off (standby-I) for the rest of RF_SUSPEND_PERIOD_MS.
+#ifdef NRF24LU1
+
+#define T1_RELOAD(ms)	((uint16_t)(0x10000UL - (ms) * 4000UL / 3))	// 0.75us per tick at 16MHz
+
+static void rf_dngl_load_t1(const uint16_t reload)
+{
+	TH1 = reload >> 8;
+	TL1 = reload & 0xff;
+}
+
+void rf_dngl_listen_isr(void) __interrupt(INTERRUPT_T1)
+{
+	TR1 = 0;
+
+	if (RFCE)
+	{
+		RFCE = 0;
+		rf_dngl_load_t1(T1_RELOAD(RF_SUSPEND_PERIOD_MS - RF_SUSPEND_RX_ON_MS));
+	} else {
+		RFCE = 1;
+		rf_dngl_load_t1(T1_RELOAD(RF_SUSPEND_RX_ON_MS));
+	}
+
+	TR1 = 1;
+}
+
+#endif	// NRF24LU1
+
+#ifdef NRF24LU1
+
+bool rf_powered_down = false;		// for the suspend
+
+// sets or clears PWR_UP, CONFIG keeps the rest of rf_profile_dongle_rx
+static void rf_dngl_power(const bool up)
+{
+	uint8_t config;
+
+	RF_IRQ_DISABLE();
+
+	nRF_ReadReg(CONFIG);
+	config = up ? nRF_data[1] | vPWR_UP : nRF_data[1] & ~vPWR_UP;
+	nRF_WriteReg(CONFIG, config);
+
+	RF_IRQ_ENABLE();
+}
+
+#endif	// NRF24LU1
+
+void rf_dngl_suspend(bool can_wake_host)
+{
+#ifdef NRF24LU1
+	if (!can_wake_host)
+	{
+		// a key can't wake the host, so there's nothing to listen for until the resume
+		nRF_CE_lo();
+		rf_dngl_power(false);
+		rf_powered_down = true;
+		return;
+	}
+
+	TMOD = (TMOD & 0x0f) | 0x10;	// Timer1 in 16 bit mode, CCLK/12
+	rf_dngl_load_t1(T1_RELOAD(RF_SUSPEND_RX_ON_MS));
+	ET1 = 1;
+	TR1 = 1;
+#endif
 }
 
-void rf_dngl_queue_ack_payload(__xdata void* buff, const uint8_t num_bytes)
+void rf_dngl_resume(void)
 {
-	// get the TX FIFO status
-	nRF_ReadReg(FIFO_STATUS);
+#ifdef NRF24LU1
+	TR1 = 0;
+	ET1 = 0;
+
+	if (rf_powered_down)
+	{
+		rf_dngl_power(true);
+		delay_us(1500);		// Tpd2stby
+		rf_powered_down = false;
+	}
+#endif
+
+	nRF_CE_hi();
+}
+
+__xdata rf_rx_packet_t* rf_dngl_recv(void)
+{
+	if (rx_ring_head == rx_ring_tail)
+		return NULL;
+
+	return &rx_ring[rx_ring_tail % RX_RING_SIZE];
+}
+
+void rf_dngl_release(void)
+{
+	const uint8_t pipe = rx_ring[rx_ring_tail % RX_RING_SIZE].pipe;
+
+	++rx_ring_tail;
+
+	RF_IRQ_DISABLE();
+
+	// the RF interrupt left packets in the RX FIFO for lack of room
+	if (rx_stalled)
+		rf_dngl_drain_rx();
+
+	rf_dngl_update_ack_payloads(pipe);
+
+	RF_IRQ_ENABLE();
+}
+
+void rf_dngl_queue_ack_payload(__xdata void* buff, const uint8_t num_bytes, const uint8_t pipe)
+{
+	const uint8_t slot = ack_slot(*(__xdata uint8_t*) buff);
+	uint8_t p;
+
+	if (slot == ACK_SLOT_COUNT  ||  num_bytes > ACK_SLOT_BYTES)
+		return;
+
+	// the RF interrupt uses the nRF too
+	RF_IRQ_DISABLE();
+
+	for (p = 0; p < RF_NUM_PIPES; ++p)
+	{
+		if (pipe != RF_ALL_PIPES  &&  pipe != p)
+			continue;
+
+		// replace the older message of the same type
+		memcpy_X(ack_slots[p][slot], buff, num_bytes);
+		ack_pending[p] |= _BV(slot);
+	}
+
+	// a payload waiting in the FIFO can't be changed, so we
+	// reload it together with the new message
+	rf_dngl_check_ack_sent();
+	if (ack_loaded  &&  ack_pending[ack_loaded_pipe])
+		rf_dngl_flush_ack_fifo();
 
-	// clear any unsent ACK payloads
-	if (!(nRF_data[1]  &  vTX_EMPTY))
-		nRF_FlushTX();
+	rf_dngl_fill_ack_fifo(RF_ALL_PIPES);
 
-	// send the payload
-	nRF_WriteAckPayload(buff, num_bytes, 0);	// pipe 0
+	RF_IRQ_ENABLE();
 }
@@ -1,6 +1,54 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tgtdefs.h"
+#include "rf_protocol.h"
+
+// Define this to print the main loop wakeups per second and the time from the RF
+// interrupt to the keyboard report in the IN endpoint with Timer0.
+// Needs DBG_MODE for the output, and works only on the nRF24LU1.
+//#define MEASURE_RX
+
+#ifdef MEASURE_RX
+extern volatile uint16_t rf_rx_stamp;			// Timer0 at the RF interrupt
+extern volatile bool rf_rx_stamp_valid;
+#endif
+
 void rf_dngl_init(void);
-uint8_t rf_dngl_recv(__xdata void* buff, uint8_t buff_size);
 
-void rf_dngl_queue_ack_payload(__xdata void* buff, uint8_t num_bytes);
\ No newline at end of file
+// a received packet and the pipe (the keyboard) it came from
+typedef struct
+{
+	uint8_t		bytes;
+	uint8_t		pipe;
+	uint8_t		payload[MAX_PAYLOAD];
+} rf_rx_packet_t;
+
+// The packets are read from the nRF by the RF interrupt (the IRQ pin change on the AVR),
+// rf_dngl_recv() doesn't touch the nRF.
+// Returns the oldest received packet, or NULL if there is none. The packet stays
+// valid until rf_dngl_release().
+__xdata rf_rx_packet_t* rf_dngl_recv(void);
+void rf_dngl_release(void);
+
+// Duty cycles the receiver while the host is suspended (see RF_SUSPEND_PERIOD_MS),
+// and keeps it on again after the resume. If a key can't wake the host, the nRF
+// is powered down until the resume instead. The V-USB dongle doesn't detect the
+// suspend, so this is done only on the nRF24LU1.
+void rf_dngl_suspend(bool can_wake_host);
+void rf_dngl_resume(void);
+
+#ifdef NRF24LU1
+// SDCC needs the ISR prototypes in the file with main()
+void rf_dngl_isr(void) __interrupt(INTERRUPT_RFIRQ);
+void rf_dngl_listen_isr(void) __interrupt(INTERRUPT_T1);
+#endif
+
+// Queues a message for the ACK payloads of the pipe, or of all the pipes with RF_ALL_PIPES.
+// The message replaces the last one of the same type if that hasn't been sent yet,
+// and goes out together with the other pending types.
+#define RF_ALL_PIPES		0xff
+
+void rf_dngl_queue_ack_payload(__xdata void* buff, uint8_t num_bytes, uint8_t pipe);
\ No newline at end of file
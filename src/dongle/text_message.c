@@ -3,6 +3,7 @@
 
 #include "keycode.h"
 #include "text_message.h"
+#include "text_templates.h"
 #include "tgtdefs.h"
 
 #define TEXT_MSG_BUFF_SIZE	128
@@ -11,6 +12,12 @@ __xdata char text_msg_buff[TEXT_MSG_BUFF_SIZE];
 __xdata uint8_t text_buff_head = 0;
 __xdata uint8_t text_buff_tail = 0;
 
+// the template or the packed number being typed out; the tokens are
+// expanded only when they reach the tail of the ring buffer
+__FLASH_ATTR const char* tmpl_ptr = NULL;
+__xdata char num_buff[11];		// 0xffffffff has 10 digits
+__xdata char* num_ptr = NULL;
+
 uint8_t msg_capacity(void)
 {
 	return TEXT_MSG_BUFF_SIZE - 1;
@@ -35,7 +42,7 @@ void msg_push(char c)
 	text_buff_head = (text_buff_head + 1) % TEXT_MSG_BUFF_SIZE;
 }
 
-char msg_pop(void)
+static char ring_pop(void)
 {
 	char ret_val = text_msg_buff[text_buff_tail];
 	text_buff_tail = (text_buff_tail + 1) % TEXT_MSG_BUFF_SIZE;
@@ -43,12 +50,177 @@ char msg_pop(void)
 	return ret_val;
 }
 
+// starts the expansion of the tokens at the tail of the ring buffer
+static void msg_expand(void)
+{
+	while (tmpl_ptr == NULL  &&  num_ptr == NULL
+			&&  text_buff_head != text_buff_tail
+			&&  IS_TEXT_TOKEN(text_msg_buff[text_buff_tail]))
+	{
+		uint8_t token = ring_pop();
+
+		if (IS_TT_NUMBER(token))
+		{
+			// decode the number; the number bytes have the high bit set, so a token
+			// cut short by the end of its text stops at the key-up or the ring's head
+			uint32_t num = 0;
+			uint8_t shift = 0;
+			uint8_t cnt = TT_NUMBER_BYTES(token);
+			while (cnt  &&  text_buff_head != text_buff_tail
+					&&  IS_TEXT_TOKEN(text_msg_buff[text_buff_tail]))
+			{
+				num |= (uint32_t)(ring_pop() & 0x7f) << shift;
+				shift += 7;
+				--cnt;
+			}
+
+			// a malformed number is dropped
+			if (cnt)
+				continue;
+
+			// and make the decimal string
+			num_ptr = num_buff + sizeof num_buff - 1;
+			*num_ptr = '\0';
+			do {
+				*--num_ptr = '0' + num % 10;
+				num /= 10;
+			} while (num);
+
+		} else if (IS_TT_TEMPLATE(token)) {
+
+			tmpl_ptr = text_templates[token - TT_FIRST];
+			if (*tmpl_ptr == '\0')
+				tmpl_ptr = NULL;
+		}
+
+		// unknown tokens are dropped
+	}
+}
+
+char msg_pop(void)
+{
+	char ret_val = msg_peek();
+
+	if (tmpl_ptr)
+	{
+		if (*++tmpl_ptr == '\0')
+			tmpl_ptr = NULL;
+	} else if (num_ptr) {
+		if (*++num_ptr == '\0')
+			num_ptr = NULL;
+	} else {
+		ring_pop();
+	}
+
+	return ret_val;
+}
+
 char msg_peek(void)
 {
-	char ret_val = text_msg_buff[text_buff_tail];
+	msg_expand();
+
+	if (tmpl_ptr)
+		return *tmpl_ptr;
+
+	if (num_ptr)
+		return *num_ptr;
+
+	return text_msg_buff[text_buff_tail];
+}
+
+// reads the 6-bit code at the bit position of the packed text
+static uint8_t unpack_code(__xdata const uint8_t* packed, uint8_t num_bytes, uint16_t bitpos)
+{
+	uint8_t ndx = bitpos >> 3;
+	uint16_t window = packed[ndx] << 8;
+	if (ndx + 1 < num_bytes)
+		window |= packed[ndx + 1];
+
+	return (window >> (10 - (bitpos & 7))) & 0x3f;
+}
+
+// Walks the packed text and pushes it into the ring buffer if do_push is set.
+// Returns the number of chars the text unpacks to.
+static uint8_t unpack_text(__xdata const uint8_t* packed, uint8_t num_bytes, bool do_push)
+{
+	const uint16_t num_bits = num_bytes * 8;
+	uint16_t bitpos = 0;
+	uint8_t ret_val = 0;
+	uint8_t code;
+	char c;
+	__FLASH_ATTR const char* word;
+
+	while (bitpos + TP_CODE_BITS <= num_bits)
+	{
+		code = unpack_code(packed, num_bytes, bitpos);
+		bitpos += TP_CODE_BITS;
+
+		if (code == TP_END)
+			break;
+
+		if (code >= TP_DICT_FIRST  &&  code < TP_DICT_FIRST + TP_DICT_COUNT)
+		{
+			word = text_pack_dict[code - TP_DICT_FIRST];
+			while (*word)
+			{
+				if (do_push)
+					msg_push(*word);
+
+				++word;
+				++ret_val;
+			}
+
+			continue;
+		}
+
+		if (code == TP_UPPER  ||  code == TP_RAW)
+		{
+			// these take the code that follows
+			if (bitpos + TP_CODE_BITS > num_bits)
+				break;
+
+			c = unpack_code(packed, num_bytes, bitpos);
+			bitpos += TP_CODE_BITS;
+
+			if (code == TP_UPPER)
+			{
+				c += 'A' - TP_LETTER_FIRST;
+			} else {
+				// and the raw byte takes one more
+				if (bitpos + TP_CODE_BITS > num_bits)
+					break;
+
+				c = (c << 6) | unpack_code(packed, num_bytes, bitpos);
+				bitpos += TP_CODE_BITS;
+			}
+
+		} else if (code < TP_DIGIT_FIRST) {
+			c = 'a' + code - TP_LETTER_FIRST;
+		} else if (code < TP_PUNCT_FIRST) {
+			c = '0' + code - TP_DIGIT_FIRST;
+		} else {
+			c = text_pack_punct[code - TP_PUNCT_FIRST];
+		}
+
+		if (do_push)
+			msg_push(c);
+
+		++ret_val;
+	}
+
 	return ret_val;
 }
 
+uint8_t msg_unpacked_size(__xdata const uint8_t* packed, uint8_t num_bytes)
+{
+	return unpack_text(packed, num_bytes, false);
+}
+
+void msg_push_packed(__xdata const uint8_t* packed, uint8_t num_bytes)
+{
+	unpack_text(packed, num_bytes, true);
+}
+
 bool msg_full(void)
 {
 	return ((text_buff_head + 1) % TEXT_MSG_BUFF_SIZE) == text_buff_tail;
@@ -56,7 +228,9 @@ bool msg_full(void)
 
 bool msg_empty(void)
 {
-	return text_buff_head == text_buff_tail;
+	msg_expand();
+
+	return tmpl_ptr == NULL  &&  num_ptr == NULL  &&  text_buff_head == text_buff_tail;
 }
 
 // this structure and the array below map a character into the 
@@ -212,3 +386,91 @@ uint8_t get_modifiers_for_char(char c)
 	uint8_t ndx = c & 0x7f;
 	return char2keycode[ndx].modifiers;
 }
+
+// the keys and modifiers of the last report we typed
+__xdata uint8_t typed_keys[TYPING_MAX_KEYS];
+uint8_t typed_modifiers;
+
+static bool is_key_in(const uint8_t* keys, const uint8_t keycode)
+{
+	uint8_t key_cnt;
+
+	for (key_cnt = 0; key_cnt < TYPING_MAX_KEYS; key_cnt++)
+	{
+		if (keys[key_cnt] == keycode)
+			return true;
+	}
+
+	return false;
+}
+
+bool msg_type_report(uint8_t* modifiers, uint8_t* keys)
+{
+	uint8_t num_keys = 0;
+	uint8_t key_cnt, keycode, mods;
+	char c;
+
+	if (msg_empty())
+		return false;
+
+	for (key_cnt = 0; key_cnt < TYPING_MAX_KEYS; key_cnt++)
+		keys[key_cnt] = KC_NO;
+
+	*modifiers = typed_modifiers;
+
+	while (num_keys < TYPING_MAX_KEYS  &&  !msg_empty())
+	{
+		c = msg_peek();
+		keycode = get_keycode_for_char(c);
+		mods = keycode == KC_NO ? 0 : get_modifiers_for_char(c);
+
+		if (num_keys == 0)
+		{
+#ifdef TYPING_MODIFIERS_ALONE
+			if (mods != typed_modifiers)
+			{
+				// release the keys with the old modifiers still down, then change the modifiers
+				if (typed_keys[0] == KC_NO)
+					*modifiers = mods;
+
+				break;
+			}
+#endif
+			// the first key decides the modifiers of the report
+			*modifiers = mods;
+
+			// a key-up (the end of a message) or a char we can't type
+			if (keycode == KC_NO)
+			{
+				msg_pop();
+				break;
+			}
+
+			// the key is still down from the last report, so this report only releases it
+			if (is_key_in(typed_keys, keycode))
+				break;
+
+		} else if (keycode == KC_NO  ||  mods != *modifiers
+					||  is_key_in(typed_keys, keycode)  ||  is_key_in(keys, keycode)) {
+			break;
+		}
+
+		keys[num_keys++] = keycode;
+		msg_pop();
+	}
+
+	typed_modifiers = *modifiers;
+	for (key_cnt = 0; key_cnt < TYPING_MAX_KEYS; key_cnt++)
+		typed_keys[key_cnt] = keys[key_cnt];
+
+	return true;
+}
+
+void msg_type_release(void)
+{
+	uint8_t key_cnt;
+
+	typed_modifiers = 0;
+	for (key_cnt = 0; key_cnt < TYPING_MAX_KEYS; key_cnt++)
+		typed_keys[key_cnt] = KC_NO;
+}
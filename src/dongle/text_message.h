@@ -1,6 +1,9 @@
 #pragma once
 
+#include "tgtdefs.h"
+
 // contains a ring buffer implementation for the text messages
+// msg_peek() and msg_pop() return the text with the template tokens expanded
 uint8_t msg_size(void);
 uint8_t msg_free(void);
 uint8_t msg_capacity(void);
@@ -10,5 +13,24 @@ char msg_peek(void);
 bool msg_full(void);
 bool msg_empty(void);
 
+// the packed text encoding (MT_TEXT_PACKED) is unpacked straight into the ring buffer
+uint8_t msg_unpacked_size(__xdata const uint8_t* packed, uint8_t num_bytes);
+void msg_push_packed(__xdata const uint8_t* packed, uint8_t num_bytes);
+
 uint8_t get_keycode_for_char(char c);
 uint8_t get_modifiers_for_char(char c);
+
+// Define this for the hosts (Linux) that get the order of the keys and modifiers wrong
+// when they change in the same report. The keys are then released before a modifier
+// change, and the modifiers change in a report of their own.
+#define TYPING_MODIFIERS_ALONE
+
+// The text is typed up to TYPING_MAX_KEYS keys per report: the chars that follow each other,
+// share their modifiers and were not down in the last report go into one report.
+// Fills the modifiers and the keys of the next report, returns false if there's no text.
+#define TYPING_MAX_KEYS		6
+
+bool msg_type_report(uint8_t* modifiers, uint8_t* keys);
+
+// tells the typing that all its keys have been released by someone else
+void msg_type_release(void);
@@ -6,6 +6,8 @@
 #include "reports.h"
 #include "rf_protocol.h"
 #include "rf_dngl.h"
+#include "dongle_core.h"
+#include "nrfdbg.h"
 
 #include "usb.h"
 
@@ -15,16 +17,26 @@
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 uint8_t		usb_current_config;
-usb_state_t	usb_state;
+volatile usb_state_t	usb_state;
+
+// the state we go back to when the host resumes
+usb_state_t	usb_resume_state;
+
+bool usb_remote_wakeup_enabled = false;		// by SET_FEATURE(DEVICE_REMOTE_WAKEUP)
+bool usb_wakeup_signalled;					// in this suspend
 
 __code const uint8_t* packetizer_data_ptr;
 uint8_t packetizer_data_size;
 
 // We are counting SOF packets as a timer for the HID idle rate.
 // usbframel & usbframeh are not good enough for this because of
-// difficulty accesing both LSB and MSB in a predictable manner
-uint16_t usbFrameCnt = 0;
-__xdata uint8_t usbHidIdle = 0;		// forever
+// difficulty accesing both LSB and MSB in a predictable manner.
+// Every interface counts the frames since its last report, and has its own idle rate.
+volatile uint16_t usbIdleFrames[USB_NUM_IFACES];
+__xdata volatile uint8_t usbHidIdle[USB_NUM_IFACES];		// in 4 ms units, 0 is forever
+
+// the LED report from SET_REPORT waiting for usbPoll()
+volatile bool usb_led_report_pending = false;
 
 void usbInit(void)
 {
@@ -42,9 +54,9 @@ void usbInit(void)
 							// 1	sofie	Start of frame interrupt enable
 							// 0	sudavie	SETUP data valid interrupt enable
 	
-	// we only want to get interrupts for EP0 IN/OUT
-	// the other interrupts are not needed (but EP1 IN is still used)
-	in_ien = 0x07;		// enable IN interrupts on EP0 and EP1
+	// EP0 IN/OUT are handled in the interrupt. The EP1 and EP2 IN interrupts only
+	// wake up the main loop to send the next queued report.
+	in_ien = 0x07;		// enable IN interrupts on EP0, EP1 and EP2
 	in_irq = 0x1f;		// reset IN interrupt flags
 	out_ien = 0x01;		// enable OUT interrupts on EP0
 	out_irq = 0x1f;		// reset OUT interrupt flags
@@ -69,23 +81,124 @@ void usbInit(void)
 	outbulkval = 0x01;	// enables OUT endpoints on EP0
 	inisoval = 0x00;	// ISO not used
 	outisoval = 0x00;	// ISO not used
+
+	USBIRQEN = 1;		// usb_isr() handles the rest, once main() sets EA
 }
 
-bool usbHasIdleElapsed(void)
+bool usb_idle_elapsed(uint8_t iface)
 {
 	bool retVal;
 	
-	if (usbHidIdle == 0)
+	if (usbHidIdle[iface] == 0)
 		return false;
 
-	retVal = usbFrameCnt >= usbHidIdle * 4;
-	
-	if (retVal)
-		usbFrameCnt = 0;
-	
+	// the SOF interrupt changes usbIdleFrames one byte at a time
+	USBIRQEN = 0;
+	retVal = usbIdleFrames[iface] >= usbHidIdle[iface] * 4;
+	USBIRQEN = 1;
+
 	return retVal;
 }
 
+// a report has been sent, the idle duration starts over
+static void usbRestartIdle(uint8_t iface)
+{
+	USBIRQEN = 0;
+	usbIdleFrames[iface] = 0;
+	USBIRQEN = 1;
+}
+
+bool usb_is_suspended(void)
+{
+	return usb_state == SUSPENDED;
+}
+
+bool usb_can_wake_host(void)
+{
+	return usb_remote_wakeup_enabled;
+}
+
+// The remote wakeup is USBCON's WU bit (reg24lu1.h), which wakes the USB controller
+// up to signal the resume; Nordic's HAL holds it for 1ms. Timer2 ends it, so the RF
+// and the main loop carry on meanwhile.
+#define USB_RESUME_SIGNAL_MS	5
+#define T2_RELOAD(ms)			((uint16_t)(0x10000UL - (ms) * 4000UL / 3))	// 0.75us per tick at 16MHz
+
+void usb_remote_wakeup(void)
+{
+	if (usb_state != SUSPENDED  ||  !usb_remote_wakeup_enabled  ||  usb_wakeup_signalled)
+		return;
+
+	usb_wakeup_signalled = true;
+
+	// the resume signalling has to last from 1 to 15ms; the host takes over from there
+	WU = 1;
+
+	TH2 = T2_RELOAD(USB_RESUME_SIGNAL_MS) >> 8;
+	TL2 = T2_RELOAD(USB_RESUME_SIGNAL_MS) & 0xff;
+	TF2 = 0;
+	ET2 = 1;
+	T2CON = 0x01;		// T2I0: CCLK/12, no reload
+}
+
+void usb_resume_signal_isr(void) __interrupt(INTERRUPT_T2)
+{
+	T2CON = 0x00;		// stop Timer2
+	TF2 = 0;			// not cleared by the hardware
+	ET2 = 0;
+
+	WU = 0;
+}
+
+// any bus activity ends the suspend
+static void usb_resume(void)
+{
+	if (usb_state == SUSPENDED)
+		usb_state = usb_resume_state;
+}
+
+bool usb_kbd_ep_ready(void)
+{
+	return (in1cs & 0x02) == 0;
+}
+
+void usb_kbd_ep_send(__xdata const hid_kbd_report_t* report)
+{
+	// copy the keyboard report into the endpoint buffer
+	in1buf[0] = report->modifiers;
+	in1buf[1] = 0;
+	in1buf[2] = report->keys[0];
+	in1buf[3] = report->keys[1];
+	in1buf[4] = report->keys[2];
+	in1buf[5] = report->keys[3];
+	in1buf[6] = report->keys[4];
+	in1buf[7] = report->keys[5];
+
+	// send the data on it's way
+	in1bc = 8;
+	usbRestartIdle(USB_IFACE_KEYBOARD);
+
+#ifdef MEASURE_RX
+	if (rf_rx_stamp_valid)
+	{
+		dprintf("RF to report %u us\n", (uint16_t)(((TH0 << 8) | TL0) - rf_rx_stamp) / 4 * 3);	// 0.75us per tick at 16MHz
+		rf_rx_stamp_valid = false;
+	}
+#endif
+}
+
+bool usb_consumer_ep_ready(void)
+{
+	return (in2cs & 0x02) == 0;
+}
+
+void usb_consumer_ep_send(uint8_t report)
+{
+	in2buf[0] = report;
+	in2bc = 1;
+	usbRestartIdle(USB_IFACE_CONSUMER);
+}
+
 void packetizer_isr_ep0_in(void)
 {
 	uint8_t size, i;
@@ -172,8 +285,8 @@ void usbStdDeviceRequest(void)
 		// We must be in ADDRESSED or CONFIGURED state, and wIndex must be 0
 		if ((usb_state == ADDRESSED || usb_state == CONFIGURED)  &&  usbRequest.wIndexLSB == 0x00)
 		{
-			// We aren't self-powered and we don't support remote wakeup
-			in0buf[0] = 0x00;
+			// We aren't self-powered
+			in0buf[0] = usb_remote_wakeup_enabled ? 0x02 : 0x00;
 			in0buf[1] = 0x00;
 			in0bc = 0x02;
 		} else {
@@ -191,6 +304,18 @@ void usbStdDeviceRequest(void)
 		usbGetDescriptor();
 		break;
 
+	case USB_REQ_SET_FEATURE:
+	case USB_REQ_CLEAR_FEATURE:
+		// remote wakeup is the only device feature
+		if (usbRequest.wValueLSB == USB_FEATURE_REMOTE_WAKEUP)
+		{
+			usb_remote_wakeup_enabled = (usbRequest.bRequest == USB_REQ_SET_FEATURE);
+			USB_EP0_HSNAK();
+		} else {
+			USB_EP0_STALL();
+		}
+		break;
+
 	case USB_REQ_GET_CONFIGURATION:
 	
 		if (usb_state == ADDRESSED)
@@ -299,19 +424,17 @@ void usbHidRequest(void)
 		// send the data on it's way
 		in0bc = 8;
 		
-	} else if (bRequest == USB_REQ_HID_GET_IDLE) {
+	} else if (bRequest == USB_REQ_HID_GET_IDLE  &&  usbRequest.wIndexLSB < USB_NUM_IFACES) {
 
-		in0buf[0] = usbHidIdle;
+		in0buf[0] = usbHidIdle[usbRequest.wIndexLSB];
 		in0bc = 0x01;
 	
-	} else if (bRequest == USB_REQ_HID_SET_IDLE) {
-
-		usbHidIdle = usbRequest.wValueMSB;
-		
-		// wValueLSB holds the reportID for which this rate applies,
-		// but we only have one, so this does not concern us
+	} else if (bRequest == USB_REQ_HID_SET_IDLE  &&  usbRequest.wIndexLSB < USB_NUM_IFACES) {
 
-		usbFrameCnt = 0;	// reset idle counter
+		// wIndexLSB is the interface. wValueLSB holds the reportID for which this
+		// rate applies, but our interfaces have one report each, so this does not concern us
+		usbHidIdle[usbRequest.wIndexLSB] = usbRequest.wValueMSB;
+		usbIdleFrames[usbRequest.wIndexLSB] = 0;	// reset idle counter
 
 		// send an empty packet and ACK the request
 		in0bc = 0x00;
@@ -355,19 +478,9 @@ void usbRequestDataReceived(void)
 {
 	if (usbRequest.bRequest == USB_REQ_HID_SET_REPORT)
 	{
-		__xdata rf_msg_led_status_t msg;
-		
+		// the main loop queues the ACK payloads too, so we leave that to usbPoll()
 		usb_led_report = out0buf[0];
-		
-		// swap the CAPS and SCROLL bits because the controller
-		// has these the other way around than the report
-		msg.msg_type = MT_LED_STATUS;
-		msg.led_status = (usb_led_report & 1)
-						| ((usb_led_report & 2) ? 4 : 0)
-						| ((usb_led_report & 4) ? 2 : 0);
-						
-		// queue the status which will be sent with the next ACK payload
-		rf_dngl_queue_ack_payload(&msg, sizeof msg);
+		usb_led_report_pending = true;
 	}
 		
 	// send an empty packet and ACK the request
@@ -377,9 +490,26 @@ void usbRequestDataReceived(void)
 
 void usbPoll(void)
 {
-	if (!USBIRQ)
+	__xdata rf_msg_led_status_t msg;
+
+	if (!usb_led_report_pending)
 		return;
 
+	usb_led_report_pending = false;
+
+	// swap the CAPS and SCROLL bits because the controller
+	// has these the other way around than the report
+	msg.msg_type = MT_LED_STATUS;
+	msg.led_status = (usb_led_report & 1)
+					| ((usb_led_report & 2) ? 4 : 0)
+					| ((usb_led_report & 4) ? 2 : 0);
+
+	// queue the status for all the keyboards; it's sent with the next ACK payload
+	rf_dngl_queue_ack_payload(&msg, sizeof msg, RF_ALL_PIPES);
+}
+
+void usb_isr(void) __interrupt(INTERRUPT_USB_INT)
+{
 	// clear USB interrupt flag
 	USBIRQ = 0;
 
@@ -396,7 +526,13 @@ void usbPoll(void)
 		break;
 	case INT_SOF:		// SOF packet
 		usbirq = 0x02;	// clear interrupt flag
-		++usbFrameCnt;
+		usb_resume();
+
+		// the counters stop at the top, an idle rate can't be that long
+		if (usbIdleFrames[USB_IFACE_KEYBOARD] != 0xffff)
+			++usbIdleFrames[USB_IFACE_KEYBOARD];
+		if (usbIdleFrames[USB_IFACE_CONSUMER] != 0xffff)
+			++usbIdleFrames[USB_IFACE_CONSUMER];
 		break;
 	/*
 	case INT_SUTOK:		// setup token
@@ -405,11 +541,20 @@ void usbPoll(void)
 		*/
 	case INT_SUSPEND:	// SUSPEND signal
 		usbirq = 0x08;	// clear interrupt flag
+
+		// the main loop duty cycles the radio and idles between the interrupts
+		if (usb_state != SUSPENDED)
+		{
+			usb_resume_state = usb_state;
+			usb_state = SUSPENDED;
+			usb_wakeup_signalled = false;
+		}
 		break;
 	case INT_USBRESET:	// USB bus reset
 		usbirq = 0x10;	// clear interrupt flag
 		usb_state = DEFAULT;	// reset internal states
 		usb_current_config = 0;
+		usb_remote_wakeup_enabled = false;
 		break;
 
 	case INT_EP0IN:
@@ -426,6 +571,7 @@ void usbPoll(void)
 		out0bc = 0x40;	// rearm the next EP0 OUT
 		break;
 
+	// the report has been sent; the main loop wakes up and sends the next one
 	case INT_EP1IN:
 		in_irq = 0x02;
 		break;
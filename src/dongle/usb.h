@@ -1,5 +1,7 @@
 #pragma once
 
+#include "reg24lu1.h"
+
 // standard request codes
 #define USB_REQ_GET_STATUS			0x00
 #define USB_REQ_CLEAR_FEATURE		0x01
@@ -13,6 +15,10 @@
 #define USB_REQ_SET_INTERFACE		0x0b
 #define USB_REQ_SYNCH_FRAME			0x0c
 
+// feature selectors
+#define USB_FEATURE_ENDPOINT_HALT		0x00
+#define USB_FEATURE_REMOTE_WAKEUP		0x01
+
 // HID request codes
 #define USB_REQ_HID_GET_REPORT		0x01
 #define USB_REQ_HID_GET_IDLE		0x02
@@ -213,15 +219,21 @@ extern __code const uint8_t usb_keyboard_report_descriptor[USB_KBD_HID_REPORT_DE
 extern __code const uint8_t usb_consumer_report_descriptor[USB_CONS_HID_REPORT_DESC_SIZE];
 
 void usbInit(void);
+
+// The USB controller is serviced by usb_isr(). usbPoll() does the rest in the main
+// loop: it queues the LED status from SET_REPORT for the keyboards.
 void usbPoll(void);
+extern volatile bool usb_led_report_pending;
+
+// SDCC needs the ISR prototypes in the file with main()
+void usb_isr(void) __interrupt(INTERRUPT_USB_INT);
+void usb_resume_signal_isr(void) __interrupt(INTERRUPT_T2);	// Timer2 ends the remote wakeup
 
-bool usbHasIdleElapsed(void);
 
 #define CAPS_LOCK_MASK		0x01
 #define NUM_LOCK_MASK		0x02
 #define SCROLL_LOCK_MASK	0x04
 
-__xdata extern uint8_t usbIdleRate;				// in 4 ms units
 
 // endpoint buffer sizes
 #define USB_EP0_SIZE	0x40
@@ -97,7 +97,7 @@ __code const usb_conf_desc_keyboard_t usb_conf_desc =
 		2,		// bNumInterfaces
 		1,		// bConfigurationValue
 		2,		// iConfiguration
-		0x80,	// bmAttributes - bus powered, no remote wakeup
+		0xa0,	// bmAttributes - bus powered, remote wakeup
 		25,		// bMaxPower == 50mA
 	},
 	
@@ -17,12 +17,21 @@
 #include "nRF24L.h"
 #include "rf_protocol.h"
 #include "rf_ctrl.h"
+#include "key_events.h"
 #include "keycode.h"
 #include "sleeping.h"
 #include "ctrl_settings.h"
 #include "calibrate_rc.h"
 #include "proc_menu.h"
 
+// Wait this many Timer2 ticks (244us) after a matrix change and scan again before
+// making a report. Near simultaneous key presses (chords, shift+letter) are then
+// sent in one packet. The nRF is powered up before the window, so most of its
+// crystal oscillator start-up is hidden by the window; the first packet waits
+// for the rest (see RF_STARTUP_TICKS).
+// Comment this out to send a report on every matrix change.
+#define KEY_COALESCE_TICKS		6		// ~1.5ms
+
 // returns false if we should enter the menu, true if we should lock the keyboard
 bool process_normal(void)
 {
@@ -30,14 +39,27 @@ bool process_normal(void)
 	bool are_all_keys_up;
 	bool ret_val = false;
 
+	// we don't know what the dongle has seen while we were away
+	key_events_resync();
+
 	do {
 		wait_for_matrix_change();
 
+		// start the radio now, it warms up while we make the report
+		rf_ctrl_prepare();
+
+#ifdef KEY_COALESCE_TICKS
+		sleep_ticks(KEY_COALESCE_TICKS);
+		if (matrix_scan())
+			++key_reports_merged;
+#endif
+
 		// make a key state report
 		rf_msg_key_state_report_t report;
 		report.msg_type = MT_KEY_STATE;
 		report.modifiers = 0;
 		report.consumer = 0;
+		memset(report.keys, KC_NO, sizeof report.keys);
 
 		uint8_t num_keys = 0;
 
@@ -56,8 +78,11 @@ bool process_normal(void)
 			if (is_pressed_keycode(KC_F6))		report.consumer |= _BV(FN_NEXT_TRACK_BIT);
 
 			// change the address to allow multi-dongle setup
-			if (is_pressed_keycode(KC_F9))		rf_set_addr(DongleAddr1);
-			if (is_pressed_keycode(KC_F10))		rf_set_addr(DongleAddr2);
+			if (is_pressed_keycode(KC_F9)  ||  is_pressed_keycode(KC_F10))
+			{
+				rf_set_addr(is_pressed_keycode(KC_F10) ? DongleAddr2 : DongleAddr1);
+				key_events_resync();
+			}
 
 			// if only Func and Esc are pressed
 			if (get_num_keys_pressed() == 2)
@@ -115,11 +140,11 @@ bool process_normal(void)
 		}
 
 		// send the report and wait for ACK
-		if (!rf_ctrl_send_message(&report, num_keys + 3))
+		if (!send_key_state(&report, num_keys))
 			return true;
 
 		// flush the ACK payloads
-		rf_ctrl_process_ack_payloads(NULL, NULL);
+		rf_ctrl_process_ack_payloads();
 
 	} while (!waiting_for_all_keys_up  ||  are_all_keys_up);
 
@@ -132,9 +157,7 @@ void process_lock(void)
 
 	for (;;)
 	{
-		sleep_ticks(0xfe);	// long, about 62ms x 3 = 190ms
-		sleep_ticks(0xfe);
-		sleep_ticks(0xfe);
+		sleep_max(3);	// long, about 62ms x 3 = 190ms
 
 		if (matrix_scan())
 		{
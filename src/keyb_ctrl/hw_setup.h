@@ -25,6 +25,11 @@
 #define NRF_SCK_PORT	B
 #define NRF_SCK_BIT		1
 
+// the SPI options of the nRF driver (see nRF24L.h)
+//#define NRF_SPI_2X
+//#define NRF_SPI_ASYNC
+//#define NRF_SPI_TIMING
+
 
 // the LEDs
 
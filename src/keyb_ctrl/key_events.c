@@ -0,0 +1,169 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "keycode.h"
+#include "rf_protocol.h"
+#include "rf_ctrl.h"
+#include "key_events.h"
+
+// comment this out to send a full key state report on every change
+#define SEND_KEY_EVENTS
+
+// send a full key state report after this many key events messages
+// so the dongle will recover if it ever gets out of sync
+#define KEY_STATE_RESYNC_PERIOD		32
+
+// the number of press/release events and the airtime used to send them
+uint32_t key_events_total, key_airtime_total;
+
+// the matrix changes merged into one report by the coalescing window,
+// and the reports not sent because they didn't change anything
+uint32_t key_reports_merged, key_reports_suppressed;
+
+// the last key state acknowledged by the dongle
+rf_msg_key_state_report_t last_report;
+
+uint8_t event_seq = 0;				// sequence number of the next event
+uint8_t msgs_since_resync = 0;		// key events messages since the last full report
+bool resync_needed = true;
+
+void key_events_resync(void)
+{
+	resync_needed = true;
+}
+
+static bool has_key(const rf_msg_key_state_report_t* report, const uint8_t keycode)
+{
+	uint8_t c;
+	for (c = 0; c < MAX_KEYS; ++c)
+	{
+		if (report->keys[c] == keycode)
+			return true;
+	}
+
+	return false;
+}
+
+static void add_event(rf_msg_key_events_t* msg, uint8_t* num_changes, const uint8_t code, const bool is_pressed)
+{
+	if (*num_changes < MAX_KEY_EVENTS)
+	{
+		msg->events[*num_changes] = code | (is_pressed ? KEY_EVENT_PRESSED : 0);
+		++msg->header;		// the event count is in the lower bits
+	}
+
+	++*num_changes;
+}
+
+// fills the message with the changes between the last acknowledged report and the new one
+// returns the number of changes which can be larger than the number of events in the message
+static uint8_t make_key_events(rf_msg_key_events_t* msg, const rf_msg_key_state_report_t* report)
+{
+	uint8_t num_changes = 0;
+	uint8_t bit, c, changed;
+
+	msg->msg_type = MT_KEY_EVENTS;
+	msg->header = KEY_EVENTS_HEADER(event_seq, 0);
+
+	// the modifiers
+	changed = last_report.modifiers ^ report->modifiers;
+	for (bit = 0; bit < 8; ++bit)
+	{
+		if (changed & _BV(bit))
+			add_event(msg, &num_changes, KEY_EVENT_MOD_FIRST + bit, report->modifiers & _BV(bit));
+	}
+
+	// the audio and media keys
+	changed = last_report.consumer ^ report->consumer;
+	for (bit = 0; bit <= FN_NEXT_TRACK_BIT; ++bit)
+	{
+		if (changed & _BV(bit))
+			add_event(msg, &num_changes, KEY_EVENT_CONS_FIRST + bit, report->consumer & _BV(bit));
+	}
+
+	// released keys first; this way we don't overflow the dongle's 6 keys on a fast roll
+	for (c = 0; c < MAX_KEYS; ++c)
+	{
+		uint8_t keycode = last_report.keys[c];
+		if (keycode != KC_NO  &&  !has_key(report, keycode))
+		{
+			// we can't encode this one - send the full state instead
+			if (keycode > KEY_EVENT_MAX_KEYCODE)
+				resync_needed = true;
+
+			add_event(msg, &num_changes, keycode, false);
+		}
+	}
+
+	// and the pressed keys
+	for (c = 0; c < MAX_KEYS; ++c)
+	{
+		uint8_t keycode = report->keys[c];
+		if (keycode != KC_NO  &&  !has_key(&last_report, keycode))
+		{
+			if (keycode > KEY_EVENT_MAX_KEYCODE)
+				resync_needed = true;
+
+			add_event(msg, &num_changes, keycode, true);
+		}
+	}
+
+	return num_changes;
+}
+
+bool send_key_state(const rf_msg_key_state_report_t* report, const uint8_t num_keys)
+{
+	bool is_sent;
+	const uint32_t airtime_before = rf_airtime_total;
+
+	rf_msg_key_events_t msg;
+	uint8_t num_changes = make_key_events(&msg, report);
+
+	// the dongle already has this state
+	if (num_changes == 0  &&  !resync_needed)
+	{
+		++key_reports_suppressed;
+		rf_ctrl_cancel_prepare();
+		return true;
+	}
+
+#ifdef SEND_KEY_EVENTS
+	if (!resync_needed
+			&&  num_changes <= MAX_KEY_EVENTS
+			&&  msgs_since_resync < KEY_STATE_RESYNC_PERIOD)
+	{
+		is_sent = rf_ctrl_send_message(&msg, num_changes + 2);
+
+		if (is_sent)
+		{
+			event_seq = (event_seq + num_changes) & KEY_EVENTS_SEQ_MASK;
+			++msgs_since_resync;
+		}
+	} else
+#endif
+	{
+		is_sent = rf_ctrl_send_message(report, num_keys + 3);
+
+		if (is_sent)
+		{
+			resync_needed = false;
+			msgs_since_resync = 0;
+		}
+	}
+
+	if (is_sent)
+	{
+		memcpy(&last_report, report, sizeof last_report);
+
+		key_events_total += num_changes;
+		key_airtime_total += rf_airtime_total - airtime_before;
+	} else {
+		// we don't know what the dongle has now
+		resync_needed = true;
+	}
+
+	return is_sent;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// stat counters
+extern uint32_t key_events_total, key_airtime_total;
+extern uint32_t key_reports_merged, key_reports_suppressed;
+
+// the next report will be sent as a full key state report
+void key_events_resync(void);
+
+// Sends the key state report to the dongle. Depending on the changes since the
+// previously sent report this is either sent as a key events message or as a full
+// key state report. The unused keys in the report must be set to KC_NO.
+// Reports equal to the last one acknowledged by the dongle are not sent.
+bool send_key_state(const rf_msg_key_state_report_t* report, const uint8_t num_keys);
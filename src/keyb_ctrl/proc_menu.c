@@ -10,6 +10,7 @@
 #include "avrdbg.h"
 #include "rf_protocol.h"
 #include "rf_ctrl.h"
+#include "key_events.h"
 #include "sleeping.h"
 #include "led.h"
 #include "nRF24L.h"
@@ -17,6 +18,154 @@
 #include "ctrl_settings.h"
 #include "calibrate_rc.h"
 #include "proc_menu.h"
+#include "text_templates.h"
+#include "text_pack.h"
+
+// the number of text buffer bytes we have sent to the dongle, and the
+// counter value up to which the dongle lets us send (see rf_protocol.h)
+uint8_t txt_sent, txt_credit_limit;
+
+// the size of the dongle's text buffer
+uint8_t txt_capacity;
+
+// the TEXT_TEMPLATES_VERSION of the dongle; 0 until we receive the credits
+uint8_t txt_templates_version;
+
+// set if the dongle's text buffer was empty when it queued the credits
+bool txt_typed_out;
+
+// the text throughput stats
+uint32_t text_chars_total, text_ticks_total;
+
+// the text payload bytes sent over the air
+uint32_t text_rf_bytes_total;
+
+// the text messages sent, and how many of them went out packed
+uint16_t text_msgs, text_packed_msgs;
+
+// the SPI bytes the nRF register shadow saved while rendering the menu, in total and the last time
+uint32_t menu_bytes_saved_total;
+uint16_t menu_bytes_saved;
+
+static uint8_t text_credits(void)
+{
+	return txt_credit_limit - txt_sent;
+}
+
+static bool dongle_has_templates(void)
+{
+	return txt_templates_version == TEXT_TEMPLATES_VERSION;
+}
+
+static void text_ack_payload(const uint8_t* payload, uint8_t num_bytes)
+{
+	if (payload[0] == MT_TEXT_CREDITS  &&  num_bytes >= sizeof(rf_msg_text_credits_t))
+	{
+		const rf_msg_text_credits_t* msg_credits = (const rf_msg_text_credits_t*) payload;
+
+		// the credits may arrive out of date; only ever move the limit forward
+		if ((int8_t)(msg_credits->credit_limit - txt_credit_limit) > 0)
+			txt_credit_limit = msg_credits->credit_limit;
+
+		txt_capacity = msg_credits->capacity;
+		txt_templates_version = msg_credits->templates_version;
+		txt_typed_out = msg_credits->typed_out;
+	}
+}
+
+// sends an empty text message; this causes the dongle to respond with its credits
+static bool text_probe(void)
+{
+	const uint8_t probe[2] = {MT_TEXT, txt_sent};	// 1 byte for the message type ID, 1 for the msg_id
+	text_rf_bytes_total += sizeof probe;
+
+	return rf_ctrl_tx_queue(probe, sizeof probe, 0)
+			&&  rf_ctrl_tx_wait();
+}
+
+// reads the text for send_text(); the template tokens are expanded
+// here if the dongle doesn't have our templates
+typedef struct
+{
+	const char*				msg;
+	bool					is_flash;
+	const __flash char*		tmpl;		// the template being expanded or NULL
+} text_reader_t;
+
+static char text_read_msg(text_reader_t* rdr)
+{
+	char c = rdr->is_flash ? pgm_read_byte(rdr->msg) : *rdr->msg;
+	++rdr->msg;
+
+	return c;
+}
+
+static char text_peek(text_reader_t* rdr)
+{
+	for (;;)
+	{
+		if (rdr->tmpl)
+		{
+			if (*rdr->tmpl)
+				return *rdr->tmpl;
+
+			rdr->tmpl = NULL;	// end of the template
+		}
+
+		char c = rdr->is_flash ? pgm_read_byte(rdr->msg) : *rdr->msg;
+		if (!IS_TT_TEMPLATE(c)  ||  dongle_has_templates())
+			return c;
+
+		rdr->tmpl = text_templates[(uint8_t) c - TT_FIRST];
+		++rdr->msg;
+	}
+}
+
+static void text_skip(text_reader_t* rdr)
+{
+	if (rdr->tmpl)
+		++rdr->tmpl;
+	else
+		++rdr->msg;
+}
+
+// returns the number of chars the dongle types for the text with tokens
+static uint8_t text_typed_chars(const char* text, uint8_t len)
+{
+	uint8_t ret_val = 0;
+	uint8_t ndx = 0;
+	while (ndx < len)
+	{
+		uint8_t c = text[ndx++];
+		if (IS_TT_NUMBER(c))
+		{
+			uint32_t num = 0;
+			uint8_t shift = 0;
+			uint8_t cnt = TT_NUMBER_BYTES(c);
+			while (cnt--)
+			{
+				num |= (uint32_t)(text[ndx++] & 0x7f) << shift;
+				shift += 7;
+			}
+
+			do {
+				++ret_val;
+				num /= 10;
+			} while (num);
+
+		} else if (IS_TT_TEMPLATE(c)) {
+
+			const __flash char* tmpl = text_templates[c - TT_FIRST];
+			while (*tmpl++)
+				++ret_val;
+
+		} else {
+			++ret_val;
+		}
+	}
+
+	return ret_val;
+}
 
 bool send_text(const char* msg, bool is_flash, bool wait_for_finish)
 {
@@ -41,75 +190,185 @@ bool send_text(const char* msg, bool is_flash, bool wait_for_finish)
 	// I'm not using the AVR Dragon any more :)
 	*/
 
-	// this message id is used to avoid presenting the same package to the dongle in case dongle
-	// received the message, but the keyboard did not receive the ACK
-	static uint8_t msg_id = 1;
-
 	rf_msg_text_t txt_msg;
-	txt_msg.msg_type = MT_TEXT;
 
-	// send the message in chunks of MAX_TEXT_LEN
-	uint16_t msglen = is_flash ? strlen_P(msg) : strlen(msg);
-	uint8_t chunklen, msg_bytes_free;
-	while (msglen)
+	// the text waiting to be sent; a packed message can take more than MAX_TEXT_LEN of it
+	char src[MAX_TEXT_LEN + MAX_TEXT_LEN / 2];
+	uint8_t src_len = 0;
+
+	text_reader_t rdr;
+	rdr.msg = msg;
+	rdr.is_flash = is_flash;
+	rdr.tmpl = NULL;
+
+	const uint16_t started = get_ticks();
+
+	rf_ctrl_tx_begin(NULL, text_ack_payload);
+
+	// we need to know if the dongle has our templates before we make the first chunk
+	if (txt_templates_version == 0  &&  !text_probe())
 	{
-		// flush the ACK payload
-		rf_ctrl_process_ack_payloads(&msg_bytes_free, NULL);
+		rf_ctrl_tx_end();
+		return false;
+	}
 
-		// copy a chunk of the message
-		chunklen = msglen > MAX_TEXT_LEN ? MAX_TEXT_LEN : msglen;
-		if (is_flash)
-			memcpy_P(txt_msg.text, msg, chunklen);
-		else
-			memcpy(txt_msg.text, msg, chunklen);
+	// send the message in chunks of up to MAX_TEXT_LEN bytes
+	uint8_t chunklen, msg_bytes, ring_bytes;
+	char c;
+	for (;;)
+	{
+		// top up the source buffer
+		while (src_len < sizeof src  &&  (c = text_peek(&rdr)) != '\0')
+		{
+			if (IS_TT_NUMBER(c))
+			{
+				// don't split the packed numbers
+				uint8_t cnt = TT_NUMBER_BYTES(c);
+				if (src_len + 1 + cnt > sizeof src)
+					break;
 
-		msglen -= chunklen;
-		msg += chunklen;
+				src[src_len++] = text_read_msg(&rdr);
+				while (cnt--)
+					src[src_len++] = text_read_msg(&rdr);
+			} else {
+				src[src_len++] = c;
+				text_skip(&rdr);
+			}
+		}
 
-		// query the free space of the buffer on the dongle to see if
-		// it is large enough to store the next chunk
+		if (src_len == 0)
+			break;
 
-		for (;;)
+		// the plain chunk: as much as fits without splitting the numbers
+		chunklen = 0;
+		while (chunklen < src_len)
 		{
-			// send an empty text message; this causes the dongle to respond with ACK payload
-			// that contains the number of bytes available in the dongle's text buffer
-			if (!rf_ctrl_send_message(&txt_msg, 2))		// 1 byte for the message type ID, 1 for the msg_id
-				return false;
+			const uint8_t unit_len = IS_TT_NUMBER(src[chunklen]) ? 1 + TT_NUMBER_BYTES(src[chunklen]) : 1;
+			if (chunklen + unit_len > MAX_TEXT_LEN)
+				break;
 
-			rf_ctrl_process_ack_payloads(&msg_bytes_free, NULL);
+			chunklen += unit_len;
+		}
 
-			// enough space in the dongle buffer?
-			if (msg_bytes_free > chunklen + 1)
+		// send it packed if that takes more of the text
+		if (dongle_has_templates())
+		{
+			const uint8_t packed_len = text_pack(src, src_len, (uint8_t*) txt_msg.text, &msg_bytes, &ring_bytes);
+			if (packed_len > chunklen)
+			{
+				txt_msg.msg_type = MT_TEXT_PACKED;
+				chunklen = packed_len;
+				++text_packed_msgs;
+			} else {
+				txt_msg.msg_type = MT_TEXT;
+			}
+		} else {
+			txt_msg.msg_type = MT_TEXT;
+		}
+
+		if (txt_msg.msg_type == MT_TEXT)
+		{
+			memcpy(txt_msg.text, src, chunklen);
+			msg_bytes = ring_bytes = chunklen;
+		}
+
+		// the dongle needs space for the text and the key-up at the end
+		while (text_credits() < ring_bytes + 1)
+		{
+			// the ACKs of the messages in flight might bring more credits
+			if (!rf_ctrl_tx_wait())
+			{
+				rf_ctrl_tx_end();
+				return false;
+			}
+
+			if (text_credits() >= ring_bytes + 1)
 				break;
 
-			sleep_ticks(40);		// doze off a little; roughly 10ms
+			if (!text_probe())
+			{
+				rf_ctrl_tx_end();
+				return false;
+			}
+
+			if (text_credits() < ring_bytes + 1)
+				sleep_ticks(40);		// doze off a little; roughly 10ms
 		}
 
-		// set the message id and send it on it's way
-		msg_id = msg_id == 0xff ? 1 : msg_id + 1;
-		txt_msg.msg_id = msg_id;
-		if (!rf_ctrl_send_message(&txt_msg, chunklen + 2))
+		text_chars_total += text_typed_chars(src, chunklen);
+		text_rf_bytes_total += msg_bytes + 2;
+		++text_msgs;
+
+		// queue the chunk; we don't wait for the ACK as long as we have the credits
+		txt_msg.msg_id = txt_sent;
+		txt_sent += ring_bytes + 1;
+		if (!rf_ctrl_tx_queue(&txt_msg, msg_bytes + 2, 0))
+		{
+			rf_ctrl_tx_end();
 			return false;
-	}
+		}
 
-	// flush the ACK payload(s)
-	rf_ctrl_process_ack_payloads(NULL, NULL);
+		src_len -= chunklen;
+		memmove(src, src + chunklen, src_len);
+	}
 
 	// wait for the buffer on the dongle to become empty
 	// this will ensure that all the keystrokes are sent to the host and that subsequent
 	// keystrokes we're sending won't mess up the text we want output at the host
 	if (wait_for_finish)
 	{
-		uint8_t msg_bytes_capacity = 0;
-		do {
-			if (!rf_ctrl_send_message(&txt_msg, 2))
+		// the ACK payload of the first probe can be the one queued for our last text
+		// message, but that one was queued with our text in the buffer
+		txt_typed_out = false;
+		for (;;)
+		{
+			if (!text_probe())
+			{
+				rf_ctrl_tx_end();
 				return false;
+			}
+
+			if (txt_typed_out)
+				break;
+
+			sleep_ticks(40);		// the host takes a report every 1-10ms
+		}
+	}
+
+	const bool ret_val = rf_ctrl_tx_end();
+
+	text_ticks_total += get_ticks() - started;
+
+	return ret_val;
+}
 
-			rf_ctrl_process_ack_payloads(&msg_bytes_free, &msg_bytes_capacity);
-		} while (msg_bytes_free == 0  ||  msg_bytes_free != msg_bytes_capacity);
+// Appends the number to the text as a packed number token if the dongle has our
+// templates, or as decimal digits if it doesn't. Returns the end of the text.
+static char* text_number(char* buff, uint32_t num)
+{
+	if (!dongle_has_templates())
+	{
+		ultoa(num, buff, 10);
+		return strchr(buff, '\0');
 	}
 
-	return true;
+	char* pEnd = buff + 1;
+	do {
+		*pEnd++ = 0x80 | (num & 0x7f);
+		num >>= 7;
+	} while (num);
+
+	*buff = TT_NUMBER_FIRST + (pEnd - buff - 2);
+	*pEnd = '\0';
+
+	return pEnd;
+}
+
+// appends the string from flash to the text, returns the end of the text
+static char* text_append_P(char* buff, PGM_P str)
+{
+	strcpy_P(buff, str);
+	return strchr(buff, '\0');
 }
 
 // defining this makes the ADC use the two least significant bits, but adds 24 bytes to the binary
@@ -203,62 +462,129 @@ bool process_menu(void)
 	char string_buff[BUFF_SIZE];
 	for (;;)
 	{
+		const uint32_t bytes_saved_before = nRF_spi_bytes_saved;
+
 		// welcome & version
 		if (!send_text(PSTR("\x01"	// translates to Ctrl-A on the dongle
-							"7G wireless\n"
-							"firmware build " __DATE__ "  " __TIME__ "\n"
-							"battery voltage: "), true, false))
+							TT_MENU_HEADER __DATE__ "  " __TIME__
+							TT_BATTERY), true, false))
 			return true;
 
 		get_battery_voltage_str(string_buff);
 		if (!send_text(string_buff, false, false))		return true;
 
 		// RF stats
-		if (!send_text(PSTR("\nRF packet stats (total/retransmit/lost): "), true, false))		return true;
+		pEnd = text_append_P(string_buff, PSTR(TT_RF_STATS));
+		pEnd = text_number(pEnd, rf_packets_total);
+		*pEnd++ = '/';
+		pEnd = text_number(pEnd, arc_total);
+		*pEnd++ = '/';
+		text_number(pEnd, plos_total);
+		if (!send_text(string_buff, false, false))			return true;
+
+		// the airtime we are spending on a key press or release
+		pEnd = text_append_P(string_buff, PSTR(TT_AIRTIME));
+		pEnd = text_number(pEnd, key_events_total ? key_airtime_total / key_events_total : 0);
+		strcpy_P(pEnd, PSTR(TT_MICROSECONDS));
+		if (!send_text(string_buff, false, false))			return true;
+
+		// the rate the menu text is typed out at the host
+		pEnd = text_append_P(string_buff, PSTR(TT_THROUGHPUT));
+		pEnd = text_number(pEnd, text_ticks_total ? text_chars_total * 4096 / text_ticks_total : 0);	// 4096 ticks per second
+		strcpy_P(pEnd, PSTR(TT_CHARS_PER_SEC));
+		if (!send_text(string_buff, false, false))			return true;
+
+		// the bytes we sent for the menu text against the chars typed
+		pEnd = text_append_P(string_buff, PSTR(TT_TEXT_BYTES));
+		pEnd = text_number(pEnd, text_rf_bytes_total);
+		*pEnd++ = '/';
+		text_number(pEnd, text_chars_total);
+		if (!send_text(string_buff, false, false))			return true;
+
+		// how many of the text messages went out packed
+		pEnd = text_append_P(string_buff, PSTR(TT_TEXT_MSGS));
+		pEnd = text_number(pEnd, text_packed_msgs);
+		*pEnd++ = '/';
+		text_number(pEnd, text_msgs);
+		if (!send_text(string_buff, false, false))			return true;
+
+		// the reports merged by the coalescing window and the reports not sent
+		pEnd = text_append_P(string_buff, PSTR(TT_KEY_REPORTS));
+		pEnd = text_number(pEnd, key_reports_merged);
+		*pEnd++ = '/';
+		text_number(pEnd, key_reports_suppressed);
+		if (!send_text(string_buff, false, false))			return true;
+
+		// the radio keep-warm decisions
+		pEnd = text_append_P(string_buff, PSTR(TT_KEEP_WARM));
+		pEnd = text_number(pEnd, rf_warm_hits);
+		*pEnd++ = '/';
+		pEnd = text_number(pEnd, rf_warm_timeouts);
+		*pEnd++ = '/';
+		text_number(pEnd, rf_cold_starts);
+		if (!send_text(string_buff, false, false))			return true;
 
-		ultoa(rf_packets_total, string_buff, 10);
-		pEnd = strchr(string_buff, '\0');
+		// the TX completion wakeups and wait time per packet
+		pEnd = text_append_P(string_buff, PSTR(TT_TX_WAIT));
+		pEnd = text_number(pEnd, rf_tx_wakeups);
 		*pEnd++ = '/';
+		pEnd = text_number(pEnd, rf_packets_total);
+		*pEnd++ = ',';
+		*pEnd++ = ' ';
+		pEnd = text_number(pEnd, rf_packets_total ? rf_tx_wait_ticks * 244 / rf_packets_total : 0);
+		strcpy_P(pEnd, PSTR(TT_MICROSECONDS));
+		if (!send_text(string_buff, false, false))			return true;
 
-		ultoa(arc_total, pEnd, 10);
-		pEnd = strchr(string_buff, '\0');
+		// the register writes and reads the nRF driver skipped
+		pEnd = text_append_P(string_buff, PSTR(TT_REG_CACHE));
+		pEnd = text_number(pEnd, key_events_total ? (nRF_spi_bytes_saved - menu_bytes_saved_total) / key_events_total : 0);
 		*pEnd++ = '/';
+		text_number(pEnd, menu_bytes_saved);
+		if (!send_text(string_buff, false, false))			return true;
 
-		ultoa(plos_total, pEnd, 10);
+		// the latency from the matrix change to the ACK of the report
+		pEnd = text_append_P(string_buff, PSTR(TT_SCAN_TO_AIR));
+		pEnd = text_number(pEnd, rf_scan_to_air_count ? rf_scan_to_air_ticks * 244 / rf_scan_to_air_count : 0);
+		strcpy_P(pEnd, PSTR(TT_MICROSECONDS));
+		if (!send_text(string_buff, false, false))			return true;
+
+#ifdef NRF_SPI_TIMING
+		// the CPU cycles per payload byte: awake, and from the start to the end of the transfer
+		pEnd = text_append_P(string_buff, PSTR("\nSPI cycles per payload byte (active/wall): "));
+		pEnd = text_number(pEnd, nRF_spi_payload_bytes ? nRF_spi_active_cycles / nRF_spi_payload_bytes : 0);
+		*pEnd++ = '/';
+		text_number(pEnd, nRF_spi_payload_bytes ? nRF_spi_wall_cycles / nRF_spi_payload_bytes : 0);
 		if (!send_text(string_buff, false, false))			return true;
+#endif
 
 		// output the time since reset
 		uint16_t days;
 		uint8_t hours, minutes, seconds;
 		get_time(&days, &hours, &minutes, &seconds);
-		if (!send_text(PSTR("\nkeyboard's been on for "), true, false))		return true;
 
-		string_buff[0] = '\0';
+		pEnd = text_append_P(string_buff, PSTR(TT_UPTIME));
 		if (days > 0)
 		{
-			itoa(days, string_buff, 10);
-			strcat_P(string_buff, PSTR(" days "));
+			pEnd = text_number(pEnd, days);
+			pEnd = text_append_P(pEnd, PSTR(TT_DAYS));
 		}
 
 		if (hours > 0  ||  days > 0)
 		{
-			itoa(hours, strchr(string_buff, 0), 10);
-			pEnd = strlcat_P(string_buff, PSTR(" hours "), BUFF_SIZE) + string_buff;
-		} else {
-			pEnd = strchr(string_buff, 0);
+			pEnd = text_number(pEnd, hours);
+			pEnd = text_append_P(pEnd, PSTR(TT_HOURS));
 		}
 
-		itoa(minutes, pEnd, 10);
-		pEnd = strlcat_P(string_buff, PSTR(" minutes "), BUFF_SIZE) + string_buff;
+		pEnd = text_number(pEnd, minutes);
+		pEnd = text_append_P(pEnd, PSTR(TT_MINUTES));
 
-		itoa(seconds, pEnd, 10);
-		strcat_P(string_buff, PSTR(" seconds\n"));
+		pEnd = text_number(pEnd, seconds);
+		strcpy_P(pEnd, PSTR(TT_SECONDS));
 
 		if (!send_text(string_buff, false, true))		return true;
 
 		// menu
-		if (!send_text(PSTR("\n\nwhat do you want to do?\n"
-							"F1 - change transmitter output power (current "), true, false))		return true;
+		if (!send_text(PSTR(TT_MENU_POWER), true, false))		return true;
 		switch (get_nrf_output_power())
 		{
 		case vRF_PWR_M18DBM:	send_text(PSTR("-18"), true, false); 	break;
@@ -267,39 +593,33 @@ bool process_menu(void)
 		case vRF_PWR_0DBM:		send_text(PSTR("0"), true, false); 		break;
 		}
 
-		if (!send_text(PSTR("dBm)\nF2 - change LED brightness (current "), true, false))		return true;
+		pEnd = text_append_P(string_buff, PSTR(TT_MENU_BRIGHTNESS));
 
 		uint8_t fcnt;
 		for (fcnt = 0; fcnt < sizeof led_brightness_lookup; ++fcnt)
 		{
 			if (led_brightness_lookup[fcnt] == get_led_brightness())
 			{
-				string_buff[0] = 'F';
-				itoa(fcnt + 1, string_buff + 1, 10);
+				*pEnd++ = 'F';
+				pEnd = text_number(pEnd, fcnt + 1);
 				break;
 			}
 		}
 
 		// no match found in the loop?
 		if (fcnt == sizeof led_brightness_lookup)
-			itoa(get_led_brightness(), string_buff, 10);
-
-		if (!send_text(string_buff, false, false))
-			return true;
-
-		if (!send_text(PSTR(")\nF3 - lock keyboard (unlock with Func+Del+LCtrl)\n"
-							"F4 - reset RF packet stats\n"
-							"F5 - refresh this menu\n"
-							"F6 - calibrate internal RC oscillator (OSCCAL="), true, false))
-			return true;
+			pEnd = text_number(pEnd, get_led_brightness());
 
 		// output OSCCAL
-		itoa(OSCCAL, string_buff, 10);
+		pEnd = text_append_P(pEnd, PSTR(TT_MENU_OTHER));
+		pEnd = text_number(pEnd, OSCCAL);
+		strcpy_P(pEnd, PSTR(TT_MENU_ESC));
+
 		if (!send_text(string_buff, false, false))
 			return true;
 
-		if (!send_text(PSTR(")\nEsc - exit menu\n\n"), true, false))
-			return true;
+		menu_bytes_saved = nRF_spi_bytes_saved - bytes_saved_before;
+		menu_bytes_saved_total += menu_bytes_saved;
 
 		// get the user response
 		do {
@@ -308,7 +628,7 @@ bool process_menu(void)
 
 		if (keycode == KC_F1)
 		{
-			if (!send_text(PSTR("select power:\nF1 0dBm\nF2 -6dBm\nF3 -12dBm\nF4 -18dBm\n"), true, false))
+			if (!send_text(PSTR(TT_SELECT_POWER), true, false))
 				return true;
 
 			while (1)
@@ -324,7 +644,7 @@ bool process_menu(void)
 				}
 			}
 		} else if (keycode == KC_F2) {
-			if (!send_text(PSTR("press F1 (dimmest) to F12 (brightest) for brightness, Esc to finish\n"), true, false))
+			if (!send_text(PSTR(TT_SELECT_BRIGHTNESS), true, false))
 				return true;
 
 			do {
@@ -337,13 +657,26 @@ bool process_menu(void)
 			} while (keycode != KC_ESC);
 
 		} else if (keycode == KC_F3) {
-			send_text(PSTR("Keyboard is now LOCKED!!!\nPress Func+Del+LCtrl to unlock\n\n"), true, false);
+			send_text(PSTR(TT_LOCKED), true, false);
 			return true;
 
 		} else if (keycode == KC_F4) {
 
 			// reset the counters to 0
 			plos_total = arc_total = rf_packets_total = 0;
+			rf_airtime_total = 0;
+			key_events_total = key_airtime_total = 0;
+			key_reports_merged = key_reports_suppressed = 0;
+			text_chars_total = text_ticks_total = 0;
+			text_rf_bytes_total = 0;
+			text_msgs = text_packed_msgs = 0;
+			nRF_spi_bytes_saved = menu_bytes_saved_total = 0;
+			rf_warm_hits = rf_warm_timeouts = rf_cold_starts = 0;
+			rf_tx_wakeups = rf_tx_wait_ticks = 0;
+			rf_scan_to_air_ticks = rf_scan_to_air_count = 0;
+#ifdef NRF_SPI_TIMING
+			nRF_spi_payload_bytes = nRF_spi_wall_cycles = nRF_spi_active_cycles = 0;
+#endif
 
 		} else if (keycode == KC_F6) {
 
@@ -353,7 +686,7 @@ bool process_menu(void)
 		} else if (keycode == KC_ESC) {
 
 			start_led_sequence(led_seq_menu_end);
-			send_text(PSTR("\nexiting menu, you can type now\n"), true, true);
+			send_text(PSTR(TT_EXIT_MENU), true, true);
 			break;
 		}
 	}
@@ -4,10 +4,12 @@
 #include <stdio.h>
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "nRF24L.h"
+#include "rf_profiles.h"
 #include "rf_protocol.h"
 #include "rf_ctrl.h"
 #include "led.h"
@@ -22,8 +24,75 @@
 // we want to count the lost packets
 uint32_t plos_total, arc_total, rf_packets_total;
 
+// the time the transmitter spent sending our packets in us
+uint32_t rf_airtime_total;
+
+// the time on air of one packet in us at 2Mbps: 1 byte preamble, 5 byte address,
+// 9 bit packet control field and 2 byte CRC plus the payload
+#define PACKET_AIRTIME_US(payload_bytes)	((73 + (payload_bytes) * 8) / 2)
+
+// After a packet is sent we can keep the nRF in standby-I instead of powering it down.
+// This saves the power down -> standby start-up (1.5ms of the crystal oscillator
+// starting) on the next packet, but standby-I draws 26uA while we wait for it.
+// We keep the radio warm only if the average interval between our packets is shorter
+// than the break-even interval, and at most for the duration of the keep-warm window.
+
+// The start-up costs about 1.5ms x 400uA; standby-I costs as much in 23ms.
+#define RF_WARM_BREAKEVEN_TICKS		96		// ~23ms
+
+// the keep-warm window in Timer2 ticks (244us); standing by any longer than the
+// break-even interval costs more than the next start-up
+#define RF_WARM_WINDOW_TICKS		RF_WARM_BREAKEVEN_TICKS
+
+// the longest packet interval we count into the average
+#define RF_MAX_INTERVAL_TICKS		0x3fff
+
+bool rf_is_warm = false;				// is the nRF in standby-I?
+bool rf_early_power_up = false;			// was it powered up by rf_ctrl_prepare()?
+uint16_t rf_last_tx_ticks;				// when did we send the last packet
+uint16_t rf_avg_interval_ticks = RF_MAX_INTERVAL_TICKS;
+
+// The nRF needs 1.5ms (Tpd2stby) from the power up to standby-I before a CE pulse
+// sends anything. get_ticks() may advance right after the power up, so we wait
+// for one tick more than the 7 whole ticks (1.7ms) we need.
+#define RF_STARTUP_TICKS			8
+
+uint16_t rf_power_up_ticks;				// when did we power up the nRF
+bool rf_starting_up = false;			// is the start-up still to be waited out?
+
+// keep-warm decision stats
+uint32_t rf_warm_hits;			// packets sent with the radio already in standby
+uint32_t rf_warm_timeouts;		// the window expired before the next packet
+uint32_t rf_cold_starts;		// packets that needed a power up
+
+// the MCU wakeups and the time we spent waiting for the nRF to finish sending
+uint32_t rf_tx_wakeups, rf_tx_wait_ticks;
+
+// the time from rf_ctrl_prepare() to the ACK of the first packet after it
+uint16_t rf_prepare_ticks;
+bool rf_is_prepared = false;
+uint32_t rf_scan_to_air_ticks, rf_scan_to_air_count;
+
+// The nRF IRQ pin change interrupt wakes us from sleep when the transmission is done.
+// The Timer2 deadline is only a watchdog: 1.5ms start-up plus 16 attempts with
+// ARD=250us and the longest packet take about 11ms.
+#define RF_TX_WATCHDOG_TICKS		64		// ~15.6ms
+
+// 16 attempts with RF_SUSPEND_ARD take about 55ms
+#define RF_TX_WATCHDOG_LONG_TICKS	255		// ~62ms
+
+// While the host is suspended the dongle listens only part of the time (see RF_SUSPEND_ARD).
+// We learn that from the MT_HOST_STATE ACK payload, and until then a packet that doesn't
+// get through with the normal ARD is retried with the long one.
+bool rf_host_suspended = false;
+bool rf_long_ard = false;				// is SETUP_RETR set to RF_SUSPEND_ARD?
+
 #define NRF_CHECK_MODULE
 
+// the nRF IRQ pin change wakes us up
+ISR(PCINT0_vect)
+{}
+
 void rf_set_addr(const uint8_t* addr)
 {
 	// write the addresses
@@ -34,11 +103,31 @@ void rf_set_addr(const uint8_t* addr)
 	nRF_WriteAddrReg(RX_ADDR_P0, addr, NRF_ADDR_SIZE);
 }
 
+// fills addr with the dongle's address of the pipe
+static void rf_get_pipe_addr(const uint8_t pipe, uint8_t* addr)
+{
+	if (pipe == 0)
+	{
+		memcpy(addr, DongleAddr1, NRF_ADDR_SIZE);
+	} else {
+		memcpy(addr, DongleAddr2, NRF_ADDR_SIZE);
+		addr[0] = PIPE_ADDR_LSB(pipe);
+	}
+}
+
+void rf_set_pipe(const uint8_t pipe)
+{
+	uint8_t addr[NRF_ADDR_SIZE];
+
+	rf_get_pipe_addr(pipe, addr);
+	rf_set_addr(addr);
+}
+
 void rf_ctrl_init(void)
 {
 	nRF_Init();
 
-	rf_set_addr(DongleAddr1);
+	rf_set_pipe(RF_PIPE);
 
 #ifdef NRF_CHECK_MODULE
 
@@ -51,9 +140,11 @@ void rf_ctrl_init(void)
 	nRF_ReadAddrReg(TX_ADDR, NRF_ADDR_SIZE);	// read the address back
 
 	// compare
-	if (memcmp(nRF_data + 1, &DongleAddr1, NRF_ADDR_SIZE) != 0)
+	uint8_t addr[NRF_ADDR_SIZE];
+	rf_get_pipe_addr(RF_PIPE, addr);
+	if (memcmp(nRF_data + 1, addr, NRF_ADDR_SIZE) != 0)
 	{
-		printf("buff=%02x %02x %02x %02x %02x\n", DongleAddr1[0], DongleAddr1[1], DongleAddr1[2], DongleAddr1[3], DongleAddr1[4]);
+		printf("buff=%02x %02x %02x %02x %02x\n", addr[0], addr[1], addr[2], addr[3], addr[4]);
 		printf("nRF_=%02x %02x %02x %02x %02x\n", nRF_data[1], nRF_data[2], nRF_data[3], nRF_data[4], nRF_data[5]);
 		
 		// toggle the CAPS LED forever
@@ -67,86 +158,376 @@ void rf_ctrl_init(void)
 
 #endif	// NRF_CHECK_MODULE
 
-	nRF_WriteReg(EN_AA, vENAA_P0);			// enable auto acknowledge
-	nRF_WriteReg(EN_RXADDR, vERX_P0);		// enable RX address (for ACK)
-	
-	nRF_WriteReg(SETUP_RETR, vARD_250us 	// auto retransmit delay - ARD
-							| 0x0f);		// auto retransmit count - ARC
-	nRF_WriteReg(FEATURE, vEN_DPL | vEN_ACK_PAY);	// enable dynamic payload length and ACK payload
-	nRF_WriteReg(DYNPD, vDPL_P0);					// enable dynamic payload length for pipe 0
+	rf_apply_profile(rf_profile_keyb_tx);
+
+#ifdef NRF_CHECK_MODULE
+	// a module that takes the address but not the rest of the config is no good either
+	if (!rf_verify_profile(rf_profile_keyb_tx))
+	{
+		for (;;)
+		{
+			TogBit(PORT(LED_CAPS_PORT), LED_CAPS_BIT);
+
+			_delay_ms(100);
+		}
+	}
+#endif
 
 	nRF_FlushRX();
 	nRF_FlushTX();
 	
 	nRF_WriteReg(STATUS, vRX_DR | vTX_DS | vMAX_RT);	// reset the IRQ flags
-	nRF_WriteReg(RF_CH, CHANNEL_NUM);					// set the channel
+
+	// enable the pin change interrupt on the nRF IRQ pin
+	PCMSK0 |= _BV(PCINT6);
+	EIMSK |= _BV(PCIE0);
 	
 	// reset the the lost packet counters
 	plos_total = arc_total = rf_packets_total = 0;
+	rf_airtime_total = 0;
+	rf_warm_hits = rf_warm_timeouts = rf_cold_starts = 0;
+	rf_tx_wakeups = rf_tx_wait_ticks = 0;
+	rf_scan_to_air_ticks = rf_scan_to_air_count = 0;
 }
 
-bool rf_ctrl_send_message(const void* buff, const uint8_t num_bytes)
+// call only while the nRF is not sending
+static void rf_ctrl_set_long_ard(const bool long_ard)
 {
-	nRF_WriteReg(RF_SETUP, vRF_DR_2MBPS			// data rate 
-							| get_nrf_output_power());	// output power
+	nRF_WriteReg(SETUP_RETR, (long_ard ? RF_SUSPEND_ARD : vARD_250us) | 0x0f);	// ARC=15, see rf_profile_keyb_tx
+	rf_long_ard = long_ard;
+}
 
-	nRF_FlushTX();
+static void rf_ctrl_power_down(void)
+{
+	nRF_WriteReg(CONFIG, vEN_CRC | vCRCO);		// nRF power down
+	rf_is_warm = rf_early_power_up = rf_starting_up = false;
+}
+
+static void rf_ctrl_power_up(void)
+{
 	nRF_WriteReg(CONFIG, vEN_CRC | vCRCO | vPWR_UP);	// power up
-	nRF_WriteReg(STATUS, vTX_DS | vRX_DR | vMAX_RT);	// reset the status flag
-	nRF_WriteTxPayload(buff, num_bytes);
-	
-	bool is_sent;
+	rf_power_up_ticks = get_ticks();
+	rf_starting_up = true;
+	++rf_cold_starts;
+}
+
+// sleeps through what is left of the nRF start-up after a power up
+static void rf_ctrl_wait_startup(void)
+{
+	if (rf_starting_up)
+	{
+		const uint16_t elapsed = get_ticks() - rf_power_up_ticks;
+		if (elapsed < RF_STARTUP_TICKS)
+			sleep_ticks(RF_STARTUP_TICKS - elapsed);
+
+		rf_starting_up = false;
+	}
+}
+
+void rf_ctrl_prepare(void)
+{
+	rf_prepare_ticks = get_ticks();
+	rf_is_prepared = true;
+
+	// the radio is not warm until rf_ctrl_tx_start_head() waits out the start-up
+	if (!rf_is_warm  &&  !rf_early_power_up)
+	{
+		rf_ctrl_power_up();
+		rf_early_power_up = true;
+	}
+}
+
+void rf_ctrl_cancel_prepare(void)
+{
+	rf_is_prepared = false;
+
+	// a warm radio was not powered up for this, it waits for its window as usual
+	if (rf_early_power_up)
+		rf_ctrl_power_down();
+}
+
+uint8_t rf_ctrl_standby_poll(void)
+{
+	const uint16_t now = get_ticks();
+	uint16_t elapsed;
+
+	if (rf_is_warm)
+	{
+		elapsed = now - rf_last_tx_ticks;
+		if (elapsed < RF_WARM_WINDOW_TICKS)
+			return RF_WARM_WINDOW_TICKS - elapsed;
+
+		++rf_warm_timeouts;
+		rf_ctrl_power_down();
+	} else if (rf_early_power_up) {
+		elapsed = now - rf_power_up_ticks;
+		if (elapsed < RF_WARM_WINDOW_TICKS)
+			return RF_WARM_WINDOW_TICKS - elapsed;
+
+		// prepared, but nothing was sent; counted as a cold start already
+		rf_ctrl_power_down();
+	}
+
+	return 0xff;
+}
+
+// updates the average packet interval and decides if we should keep the nRF warm
+static void rf_ctrl_update_cadence(void)
+{
+	uint16_t now = get_ticks();
+	uint16_t interval = now - rf_last_tx_ticks;
+	if (interval > RF_MAX_INTERVAL_TICKS)
+		interval = RF_MAX_INTERVAL_TICKS;
+
+	// exponential moving average with 1/4 weight of the new interval
+	rf_avg_interval_ticks = (rf_avg_interval_ticks * 3 + interval) / 4;
+
+	rf_last_tx_ticks = now;
+}
+
+// the state of the queued TX session
+rf_tx_done_cb_t rf_tx_done_cb;
+rf_ack_payload_cb_t rf_ack_payload_cb;
+
+// the packets in the nRF TX FIFO; the head is the one being sent
+#define TX_FIFO_DEPTH	3
+uint8_t tx_fifo_tag[TX_FIFO_DEPTH];
+uint8_t tx_fifo_bytes[TX_FIFO_DEPTH];
+uint8_t tx_fifo_head, tx_fifo_count;
+
+bool tx_head_started;		// have we pulsed CE for the head packet?
+bool tx_failed;				// a packet could not be delivered in this session
+
+// starts sending the packet at the head of the TX FIFO
+static void rf_ctrl_tx_start_head(void)
+{
+	// a CE pulse in power down -> standby start-up is lost
+	rf_ctrl_wait_startup();
+
+	// a CE pulse of at least 10us sends exactly one packet and
+	// the nRF returns to standby-I when it's done
+	nRF_CE_hi();
+	_delay_us(15);
+	nRF_CE_lo();
+
+	tx_head_started = true;
+}
+
+// splits an ACK payload into its messages (see ACK_MSG_SIZE); the LED status is
+// handled here, everything else is passed to the callback if there is one
+static void rf_ctrl_split_ack_payload(const uint8_t* payload, uint8_t bytes, rf_ack_payload_cb_t ack_payload)
+{
+	uint8_t msg_bytes;
+	while (bytes  &&  (msg_bytes = ACK_MSG_SIZE(payload[0])) != 0  &&  msg_bytes <= bytes)
+	{
+		if (payload[0] == MT_LED_STATUS)
+			set_leds(payload[1], 25);
+		else if (payload[0] == MT_HOST_STATE)
+			rf_host_suspended = (payload[1] & HOST_SUSPENDED) != 0;		// used from the next session
+		else if (ack_payload)
+			ack_payload(payload, msg_bytes);
+
+		payload += msg_bytes;
+		bytes -= msg_bytes;
+	}
+}
+
+// reads the ACK payloads from the RX FIFO and passes them to the ACK payload callback
+static void rf_ctrl_dispatch_ack_payloads(void)
+{
+	uint8_t buff[MAX_ACK_PAYLOAD];
+	uint8_t bytes;
+	while ((bytes = rf_ctrl_read_ack_payload(buff, sizeof buff)) != 0)
+		rf_ctrl_split_ack_payload(buff, bytes, rf_ack_payload_cb);
+}
+
+// removes the head packet from our TX FIFO state and reports it
+static void rf_ctrl_tx_pop_head(bool is_sent)
+{
+	const uint8_t tag = tx_fifo_tag[tx_fifo_head];
+
+	tx_fifo_head = (tx_fifo_head + 1) % TX_FIFO_DEPTH;
+	--tx_fifo_count;
+	tx_head_started = false;
+
+	if (rf_tx_done_cb)
+		rf_tx_done_cb(tag, is_sent);
+}
+
+// waits for the head packet to be delivered; retransmits it with a backoff if it's not
+static bool rf_ctrl_tx_complete_head(void)
+{
+	const uint8_t num_bytes = tx_fifo_bytes[tx_fifo_head];
 
 	uint8_t attempts = 0;
 	const uint8_t MAX_ATTEMPTS = 45;
 
 	uint8_t ticks = 15;
 	const uint8_t TICKS_INCREMENT = 20;
-	
-	do {
-		nRF_CE_hi();	// signal the transceiver to send the packet
 
-		// wait for the nRF to signal an event
-		sleep_ticks(3);
-		while (PIN(NRF_IRQ_PORT) & _BV(NRF_IRQ_BIT))
-			sleep_ticks(1);
+	for (;;)
+	{
+		if (!tx_head_started)
+			rf_ctrl_tx_start_head();
 
-		nRF_CE_lo();
+		// sleep until the nRF signals TX_DS or MAX_RT on the IRQ pin
+		uint8_t watchdog = rf_long_ard ? RF_TX_WATCHDOG_LONG_TICKS : RF_TX_WATCHDOG_TICKS;
+		while (watchdog  &&  (PIN(NRF_IRQ_PORT) & _BV(NRF_IRQ_BIT)))
+		{
+			const uint8_t slept = sleep_ticks_until_low(&PIN(NRF_IRQ_PORT), _BV(NRF_IRQ_BIT), watchdog);
+			watchdog -= slept;
+			rf_tx_wait_ticks += slept;
+			++rf_tx_wakeups;
+		}
 
 		const uint8_t status = nRF_NOP();	// read the status reg
-		is_sent = (status & vTX_DS) != 0;	// did we get an ACK?
+		const bool is_sent = (status & vTX_DS) != 0;	// did we get an ACK?
 
 		nRF_WriteReg(STATUS, vMAX_RT | vTX_DS | vRX_DR);	// reset the status flags
-		
+
 		// read the ARC
 		nRF_ReadReg(OBSERVE_TX);
 		arc_total += nRF_data[1] & 0x0f;
-		
+		rf_airtime_total += ((nRF_data[1] & 0x0f) + 1) * PACKET_AIRTIME_US(num_bytes);
+
 		++rf_packets_total;
-		
-		if (!is_sent)
+		++attempts;
+
+		if (is_sent)
 		{
-			++plos_total;
-			nRF_ReuseTxPayload();		// send the last message again
-			
-			if (ticks >= 0xfe - TICKS_INCREMENT)
+			if (rf_is_prepared)
 			{
-				sleep_max(5);		// 63ms*5 == 0.315sec
-			} else {
-				sleep_ticks(ticks);
-				ticks += TICKS_INCREMENT;
+				rf_scan_to_air_ticks += (uint16_t)(get_ticks() - rf_prepare_ticks);
+				++rf_scan_to_air_count;
+				rf_is_prepared = false;
 			}
+
+			rf_ctrl_tx_pop_head(true);
+
+			// get the next packet on the air while we handle the ACK payload
+			if (tx_fifo_count)
+				rf_ctrl_tx_start_head();
+
+			if (rf_ack_payload_cb)
+				rf_ctrl_dispatch_ack_payloads();
+
+			return true;
 		}
 
-		++attempts;
+		++plos_total;
 
-	} while (!is_sent  &&  attempts < MAX_ATTEMPTS);
+		if (attempts == MAX_ATTEMPTS)
+			break;
+
+		// the packet stays in the TX FIFO after MAX_RT; back off and send it again
+		tx_head_started = false;
+
+		// the dongle might have gone to its part time listening since our last packet
+		if (!rf_long_ard)
+			rf_ctrl_set_long_ard(true);
+
+		if (ticks >= 0xfe - TICKS_INCREMENT)
+		{
+			sleep_max(5);		// 63ms*5 == 0.315sec
+		} else {
+			sleep_ticks(ticks);
+			ticks += TICKS_INCREMENT;
+		}
+	}
+
+	// give up on this and all the other queued packets
+	nRF_FlushTX();
+	while (tx_fifo_count)
+		rf_ctrl_tx_pop_head(false);
+
+	tx_failed = true;
+
+	return false;
+}
+
+void rf_ctrl_tx_begin(rf_tx_done_cb_t tx_done, rf_ack_payload_cb_t ack_payload)
+{
+	rf_tx_done_cb = tx_done;
+	rf_ack_payload_cb = ack_payload;
+
+	tx_fifo_head = tx_fifo_count = 0;
+	tx_head_started = tx_failed = false;
+
+	nRF_WriteReg(RF_SETUP, vRF_DR_2MBPS			// data rate 
+							| get_nrf_output_power());	// output power
+
+	nRF_FlushTX();
+
+	rf_ctrl_set_long_ard(rf_host_suspended);
+
+	if (rf_is_warm)
+		++rf_warm_hits;
+	else if (!rf_early_power_up)
+		rf_ctrl_power_up();
+
+	// don't let rf_ctrl_standby_poll() power us down while sending
+	rf_is_warm = rf_early_power_up = false;
+
+	nRF_WriteReg(STATUS, vTX_DS | vRX_DR | vMAX_RT);	// reset the status flag
+
+	// handle the ACK payloads left over from before
+	if (rf_ack_payload_cb)
+		rf_ctrl_dispatch_ack_payloads();
+}
+
+bool rf_ctrl_tx_queue(const void* buff, const uint8_t num_bytes, const uint8_t tag)
+{
+	if (tx_failed)
+		return false;
+
+	// wait for a free slot in the TX FIFO
+	if (tx_fifo_count == TX_FIFO_DEPTH  &&  !rf_ctrl_tx_complete_head())
+		return false;
+
+	nRF_WriteTxPayload(buff, num_bytes);
+
+	const uint8_t ndx = (tx_fifo_head + tx_fifo_count) % TX_FIFO_DEPTH;
+	tx_fifo_tag[ndx] = tag;
+	tx_fifo_bytes[ndx] = num_bytes;
+	++tx_fifo_count;
+
+	if (!tx_head_started)
+		rf_ctrl_tx_start_head();
+
+	return true;
+}
+
+bool rf_ctrl_tx_wait(void)
+{
+	while (tx_fifo_count)
+		rf_ctrl_tx_complete_head();
+
+	return !tx_failed;
+}
+
+bool rf_ctrl_tx_end(void)
+{
+	const bool is_sent = rf_ctrl_tx_wait();
+
+	// stay in standby-I if we expect the next packet soon enough; the latency
+	// doesn't matter while the host is suspended
+	rf_ctrl_update_cadence();
+	if (is_sent  &&  !rf_host_suspended  &&  rf_avg_interval_ticks <= RF_WARM_BREAKEVEN_TICKS)
+		rf_is_warm = true;
+	else
+		rf_ctrl_power_down();
 
-	nRF_WriteReg(CONFIG, vEN_CRC | vCRCO);		// nRF power down
-	
 	return is_sent;
 }
 
+bool rf_ctrl_send_message(const void* buff, const uint8_t num_bytes)
+{
+	// the ACK payloads stay in the RX FIFO for rf_ctrl_process_ack_payloads()
+	rf_ctrl_tx_begin(NULL, NULL);
+	rf_ctrl_tx_queue(buff, num_bytes, 0);
+	return rf_ctrl_tx_end();
+}
+
 uint8_t rf_ctrl_read_ack_payload(void* buff, const uint8_t buff_size)
 {
 	uint8_t ret_val = 0;
@@ -159,17 +540,18 @@ uint8_t rf_ctrl_read_ack_payload(void* buff, const uint8_t buff_size)
 		nRF_ReadRxPayloadWidth();
 		uint8_t ack_bytes = nRF_data[1];
 
-		// the max ACK payload size has to be 2
-		if (ack_bytes <= 32)
+		if (ack_bytes > 32)
 		{
-			// read the entire payload
-			nRF_ReadRxPayload(ack_bytes);
-
-			// copy up to buff_size bytes
-			ret_val = ack_bytes < buff_size ? ack_bytes : buff_size;
-			memcpy(buff, nRF_data + 1, ret_val);
-		} else {
 			nRF_FlushRX();
+		} else if (ack_bytes <= buff_size) {
+			// read the payload straight into the buffer
+			nRF_ReadRxPayloadTo(buff, ack_bytes);
+			ret_val = ack_bytes;
+		} else {
+			// read the entire payload and copy up to buff_size bytes
+			nRF_ReadRxPayload(ack_bytes);
+			memcpy(buff, nRF_data + 1, buff_size);
+			ret_val = buff_size;
 		}
 	}
 
@@ -186,34 +568,10 @@ void rf_ctrl_get_observe(uint8_t* arc, uint8_t* plos)
 		*plos = nRF_data[1] >> 4;
 }
 
-bool rf_ctrl_process_ack_payloads(uint8_t* msg_buff_free, uint8_t* msg_buff_capacity)
+void rf_ctrl_process_ack_payloads(void)
 {
-	// set defaults
-	if (msg_buff_free)		*msg_buff_free = 0;
-	if (msg_buff_capacity)	*msg_buff_capacity = 0;
-
-	bool ret_val = false;
-	uint8_t buff[3];
-	while (rf_ctrl_read_ack_payload(buff, sizeof buff))
-	{
-		if (buff[0] == MT_LED_STATUS)
-		{
-			set_leds(buff[1], 25);
-
-		} else if (buff[0] == MT_TEXT_BUFF_FREE) {
-			
-			ret_val = true;
-			
-			// make a proper message pointer
-			rf_msg_text_buff_state_t* msg_free_buff = (rf_msg_text_buff_state_t*) buff;
-			
-			if (msg_buff_free)
-				*msg_buff_free = msg_free_buff->bytes_free;
-				
-			if (msg_buff_capacity)
-				*msg_buff_capacity = msg_free_buff->bytes_capacity;
-		}
-	}
-	
-	return ret_val;
+	uint8_t buff[MAX_ACK_PAYLOAD];
+	uint8_t bytes;
+	while ((bytes = rf_ctrl_read_ack_payload(buff, sizeof buff)) != 0)
+		rf_ctrl_split_ack_payload(buff, bytes, NULL);
 }
@@ -2,16 +2,69 @@
 
 // stat counters
 extern uint32_t plos_total, arc_total, rf_packets_total;
+extern uint32_t rf_airtime_total;		// in us
+extern uint32_t rf_warm_hits, rf_warm_timeouts, rf_cold_starts;
+extern uint32_t rf_tx_wakeups, rf_tx_wait_ticks;
+extern uint32_t rf_scan_to_air_ticks, rf_scan_to_air_count;	// rf_ctrl_prepare() to the first ACK
 
 void rf_ctrl_init(void);
 
 // LED status will be set to LED_STATUS_NOT_RECEIVED if no status has been received
 #define LED_STATUS_NOT_RECEIVED	0xff
 
+// sends one message and waits for it to be delivered
+// the ACK payloads are left in the RX FIFO for rf_ctrl_process_ack_payloads()
 bool rf_ctrl_send_message(const void* buff, const uint8_t num_bytes);
 
+// Queued TX: up to 3 packets are kept in the nRF TX FIFO, so the next packet is
+// already waiting while the current one is on the air.
+// A session starts with rf_ctrl_tx_begin() and ends with rf_ctrl_tx_end().
+
+// called for every queued packet when it's delivered, or when we give up on it
+typedef void (*rf_tx_done_cb_t)(uint8_t tag, bool is_sent);
+
+// called for every message of the ACK payloads received during the session; the LED status is handled
+// by rf_ctrl. if the callback is NULL the ACK payloads are left in the RX FIFO.
+typedef void (*rf_ack_payload_cb_t)(const uint8_t* payload, uint8_t num_bytes);
+
+void rf_ctrl_tx_begin(rf_tx_done_cb_t tx_done, rf_ack_payload_cb_t ack_payload);
+
+// queues a packet; sleeps until a packet is delivered if the TX FIFO is full
+// the tag is passed to the tx_done callback
+// returns false if a packet could not be delivered in this session
+bool rf_ctrl_tx_queue(const void* buff, const uint8_t num_bytes, const uint8_t tag);
+
+// waits for all the queued packets to be delivered
+bool rf_ctrl_tx_wait(void);
+
+// waits for the queued packets and powers the nRF down or keeps it warm
+bool rf_ctrl_tx_end(void);
+
+// Sending is split in two: rf_ctrl_prepare() powers the radio up as soon as we know
+// we'll send, so the start-up of the nRF's crystal oscillator (1.5ms) overlaps with
+// building the report, and rf_ctrl_tx_begin()/rf_ctrl_send_message() commit the payload later.
+// The first packet still waits for whatever is left of the start-up.
+void rf_ctrl_prepare(void);
+
+// powers the radio down again if it was prepared, but there's nothing to send after all
+void rf_ctrl_cancel_prepare(void);
+
+// Powers the radio down if it has been kept in standby longer than the keep-warm window.
+// Returns the ticks until the window ends, or 0xff if the radio is powered down.
+// sleep_ticks() calls this, and wakes up when the window ends.
+uint8_t rf_ctrl_standby_poll(void);
+
 uint8_t rf_ctrl_read_ack_payload(void* buff, const uint8_t buff_size);
 
-bool rf_ctrl_process_ack_payloads(uint8_t* msg_buff_free, uint8_t* msg_buff_capacity);
+// handles the ACK payloads left in the RX FIFO by rf_ctrl_send_message()
+void rf_ctrl_process_ack_payloads(void);
+
+void rf_set_addr(const uint8_t* addr);
+
+// The dongle pipe this keyboard sends to (see RF_NUM_PIPES). Every keyboard that
+// shares a dongle needs its own pipe; build with -DRF_PIPE=n to change it.
+#ifndef RF_PIPE
+# define RF_PIPE		0
+#endif
 
-void rf_set_addr(const uint8_t* addr);
\ No newline at end of file
+void rf_set_pipe(const uint8_t pipe);
\ No newline at end of file
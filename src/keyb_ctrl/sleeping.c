@@ -10,6 +10,7 @@
 #include "led.h"
 #include "avrutils.h"
 #include "avrdbg.h"
+#include "rf_ctrl.h"
 
 // this is our watch
 // not 100% accurate, but serves the purpose
@@ -46,6 +47,13 @@ uint16_t get_seconds(void)
 	return ret_val;
 }
 
+uint16_t get_ticks(void)
+{
+	// watch is updated when we go to sleep, TCNT2 counts
+	// the time since we woke up
+	return watch.tcnt2_lword + TCNT2;
+}
+
 void get_time(uint16_t* days, uint8_t* hours, uint8_t* minutes, uint8_t* seconds)
 {
 	uint32_t sec = get_seconds32();
@@ -111,21 +119,35 @@ void add_ticks(uint16_t ticks)
 	watch.tcnt2_lword += ticks;
 }
 
+volatile bool timer2_overflow;
+
 // Timer2 overflow interrupt wakes us from sleep
 ISR(TIMER2_OVF_vect)
-{}
+{
+	timer2_overflow = true;
+}
 
-// sleep for sleep_ticks number of TCNT2 ticks
-void sleep_ticks(uint8_t ticks)
+// After a wake-up from power save TCNT2 can still read its value from before the
+// sleep. The datasheet's fix: write a Timer2 register and wait for its update.
+static void sync_timer2(void)
+{
+	OCR2A = 0;								// the compare is not used
+	loop_until_bit_is_clear(ASSR, OCR2UB);
+}
+
+static void sleep_for(uint8_t ticks)
 {
 	if (are_leds_on())
 	{
-		uint8_t prev_ticks = TCNT2;
-		
-		while (ticks--)
-			_delay_us(244.14);
-			
-		add_ticks(ticks - prev_ticks);
+		// Timer0 drives the LEDs and stops in power save, so we busy wait.
+		// TCNT2 restarts from 0 and keeps the time we wait for get_ticks()
+		// and the next add_ticks()
+		add_ticks(TCNT2);
+		TCNT2 = 0;
+		loop_until_bit_is_clear(ASSR, TCN2UB);
+
+		while (TCNT2 < ticks)
+			;
 	} else {
 		sleep_enable();
 		add_ticks(TCNT2);
@@ -134,9 +156,95 @@ void sleep_ticks(uint8_t ticks)
 		loop_until_bit_is_clear(ASSR, TCN2UB);	// wait for the update
 		
 		add_ticks(ticks);
-		sleep_mode();				// go to sleep
+
+		// The other interrupts (the nRF IRQ pin change) wake us up too, but the
+		// watch already has the whole sleep, so go back to sleep until the overflow.
+		// The flag is checked with the interrupts disabled so the overflow
+		// can't come between the check and the sleep.
+		timer2_overflow = false;
+		cli();
+		while (!timer2_overflow)
+		{
+			sei();
+			sleep_cpu();	// the instruction after sei() is executed before any interrupt
+			cli();
+		}
+		sei();
+
+		sleep_disable();
+		sync_timer2();
+	}
+}
+
+// sleep for sleep_ticks number of TCNT2 ticks
+void sleep_ticks(uint8_t ticks)
+{
+	// power the radio down if it has been idle long enough, and wake up
+	// to do it if its keep-warm window ends before this sleep does
+	const uint8_t standby_ticks = rf_ctrl_standby_poll();
+	if (standby_ticks < ticks)
+	{
+		sleep_for(standby_ticks);
+		rf_ctrl_standby_poll();
+		ticks -= standby_ticks;
+	}
+
+	sleep_for(ticks);
+}
+
+uint8_t sleep_ticks_until_low(volatile uint8_t* port_pin, uint8_t pin_mask, uint8_t ticks)
+{
+	uint8_t slept = 0;
+
+	if (are_leds_on())
+	{
+		// same as in sleep_ticks(): the time stays in TCNT2
+		add_ticks(TCNT2);
+		TCNT2 = 0;
+		loop_until_bit_is_clear(ASSR, TCN2UB);
+
+		while ((slept = TCNT2) < ticks  &&  (*port_pin & pin_mask))
+			;
+
+		if (slept > ticks)
+			slept = ticks;
+	} else {
+		sleep_enable();
+		add_ticks(TCNT2);
+
+		const uint8_t start = 0xff - ticks;
+		TCNT2 = start;							// set the sleep duration
+		loop_until_bit_is_clear(ASSR, TCN2UB);	// wait for the update
+
+		// check the pin with the interrupts disabled so a pin change
+		// between the check and the sleep can't get lost
+		cli();
+		if (*port_pin & pin_mask)
+		{
+			sei();
+			sleep_cpu();	// the instruction after sei() is executed before any interrupt
+		}
+		sei();
 		sleep_disable();
+		sync_timer2();
+
+		// TCNT2 rolls over to 0 if the timer woke us up
+		slept = TCNT2 - start;
+		if (slept > ticks)
+			slept = ticks;
+
+		if (slept < ticks)
+		{
+			// we have been woken up before the overflow; restart the counter
+			// so the next sleep_ticks() accounts only the time after this
+			TCNT2 = 0;
+			loop_until_bit_is_clear(ASSR, TCN2UB);
+		}
+
+		add_ticks(slept);
 	}
+
+	return slept;
 }
 
 const __flash sleep_schedule_period_t sleep_schedule_default[] =
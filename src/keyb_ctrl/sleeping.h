@@ -10,6 +10,11 @@ void sleep_dynamic(void);
 // sleep for the number of Timer2 counter cycles
 void sleep_ticks(uint8_t sleep_cnt);
 
+// sleep for at most ticks Timer2 counter cycles, or until the input pin pin_mask
+// of port_pin goes low. the caller has to enable the pin change interrupt of the pin.
+// returns the number of ticks slept
+uint8_t sleep_ticks_until_low(volatile uint8_t* port_pin, uint8_t pin_mask, uint8_t ticks);
+
 // sleep for the entire sleep period a given number of times
 void sleep_max(uint8_t num_times);
 
@@ -19,6 +24,10 @@ void wait_for_matrix_change(void);
 
 uint16_t get_seconds(void);
 
+// returns the number of Timer2 ticks since reset (with overflow)
+// one tick is 244.140625us
+uint16_t get_ticks(void);
+
 // these return the number of seconds since reset (with overflow)
 uint32_t get_seconds32(void);
 uint16_t get_seconds(void);